@@ -648,15 +648,15 @@ for b in xrange(0, 8):
 ####################################################################################################
 
 helper_functions.append("""\
-void JP_nn_impl(gem::CPU& cpu) {
-    cpu.reg.setPC(cpu.readPC16());
+void JP_nn_impl(gem::CPU& cpu, const gem::u16 target) {
+    cpu.reg.setPC(target);
 }""")
-Opcode('JP nn', '0xC3', 2, 12, 'JP_nn_impl(cpu);', True)
+Opcode('JP nn', '0xC3', 2, 12, 'JP_nn_impl(cpu, cpu.readPC16());', True)
 
 
 def JP_cc(cc, code, flag, reset):
     return Opcode('JP {}, nn'.format(cc), code, 2, 12, """if ({1}cpu.reg.flags.get{0}()) {{
-        JP_nn_impl(cpu);
+        JP_nn_impl(cpu, cpu.readPC16());
         ticks += 4;
     }} else {{ (void)cpu.readPC16(); }}""".format(flag, '!' if reset else ''), True)
 
@@ -670,20 +670,19 @@ Opcode('JP (HL)', '0xE9', 0, 4,
        'cpu.reg.setPC(cpu.reg.getHL());', True)
 
 helper_functions.append("""\
-void JR_n_impl(gem::CPU& cpu) {
+void JR_n_impl(gem::CPU& cpu, const gem::u8 byte) {
     using namespace gem;
-    const u8 byte = cpu.readPC();
     i8 val;
     std::memcpy(&val, &byte, sizeof val);
     cpu.reg.incPC(val);
 }""")
 
-Opcode('JR n', '0x18', 1, 12, 'JR_n_impl(cpu);', True)
+Opcode('JR n', '0x18', 1, 12, 'JR_n_impl(cpu, cpu.readPC());', True)
 
 
 def JR_cc_n(cc, code, flag, reset):
     return Opcode('JR {}, n'.format(cc), code, 1, 8, """if ({1}cpu.reg.flags.get{0}()) {{
-        JR_n_impl(cpu);
+        JR_n_impl(cpu, cpu.readPC());
         ticks += 4;
     }} else {{ (void)cpu.readPC(); }}""".format(flag, '!' if reset else ''), True)
 
@@ -694,19 +693,18 @@ JR_cc_n('NC', '0x30', 'C', True)
 JR_cc_n('C', '0x38', 'C', False)
 
 helper_functions.append("""\
-void call_impl(gem::CPU& cpu) {
+void call_impl(gem::CPU& cpu, const gem::u16 target) {
     using namespace gem;
-    const u16 target = cpu.readPC16();
     cpu.pushStack(cpu.reg.getPC());
     cpu.reg.setPC(target);
 }""")
 
-Opcode('CALL nn', '0xCD', 2, 24, 'call_impl(cpu);', True)
+Opcode('CALL nn', '0xCD', 2, 24, 'call_impl(cpu, cpu.readPC16());', True)
 
 
 def CALL_cc_nn(cc, code, flag, reset):
     return Opcode('CALL {}, nn'.format(cc), code, 2, 12, """if ({1}cpu.reg.flags.get{0}()) {{
-        call_impl(cpu);
+        call_impl(cpu, cpu.readPC16());
         ticks += 12;
     }} else {{ (void)cpu.readPC16(); }}""".format(flag, '!' if reset else ''), True)
 
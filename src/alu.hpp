@@ -26,19 +26,13 @@ inline void setAddFlags(const u8 result,
                         const bool carry,
                         const bool halfC,
                         CPU& cpu) {
-    result == 0 ? cpu.reg.flags.setZ() : cpu.reg.flags.resetZ();
-    cpu.reg.flags.resetN();
-    carry ? cpu.reg.flags.setC() : cpu.reg.flags.resetC();
-    halfC ? cpu.reg.flags.setH() : cpu.reg.flags.resetH();
+    cpu.reg.flags.assign(result == 0, false, halfC, carry);
 }
 }  // namespace detail
 
 inline void add8(u8& lhs, u8 rhs, CPU& cpu) {
-    bool carry = false, halfC = false;
-    const u16 sum = detail::addIntermediate(lhs, rhs, carry, halfC);
-
-    const u8 ret = u8(sum & 0xFF);
-    detail::setAddFlags(ret, carry, halfC, cpu);
+    const u8 ret = u8(lhs + rhs);
+    cpu.reg.flags.afterAdd(lhs, rhs, ret);
 
     lhs = ret;
 }
@@ -73,19 +67,13 @@ inline void setSubFlags(const u8 result,
                         const bool carry,
                         const bool halfC,
                         CPU& cpu) {
-    result == 0 ? cpu.reg.flags.setZ() : cpu.reg.flags.resetZ();
-    cpu.reg.flags.setN();
-    carry ? cpu.reg.flags.setC() : cpu.reg.flags.resetC();
-    halfC ? cpu.reg.flags.setH() : cpu.reg.flags.resetH();
+    cpu.reg.flags.assign(result == 0, true, halfC, carry);
 }
 }  // namespace detail
 
 inline void sub8(u8& lhs, u8 rhs, CPU& cpu) {
-    bool carry = false, halfC = false;
-    const u16 diff = detail::subIntermediate(lhs, rhs, carry, halfC);
-
-    const u8 ret = u8(diff & 0xff);
-    detail::setSubFlags(ret, carry, halfC, cpu);
+    const u8 ret = u8(lhs - rhs);
+    cpu.reg.flags.afterSub(lhs, rhs, ret);
 
     lhs = ret;
 }
@@ -103,30 +91,21 @@ inline void sbc8(u8& lhs, u8 rhs, CPU& cpu) {
 
 inline void and_(u8& lhs, u8 rhs, CPU& cpu) {
     const u8 result = lhs & rhs;
-    result == 0 ? cpu.reg.flags.setZ() : cpu.reg.flags.resetZ();
-    cpu.reg.flags.resetN();
-    cpu.reg.flags.setH();
-    cpu.reg.flags.resetC();
+    cpu.reg.flags.afterAnd(result);
 
     lhs = result;
 }
 
 inline void or_(u8& lhs, u8 rhs, CPU& cpu) {
     const u8 result = lhs | rhs;
-    result == 0 ? cpu.reg.flags.setZ() : cpu.reg.flags.resetZ();
-    cpu.reg.flags.resetN();
-    cpu.reg.flags.resetH();
-    cpu.reg.flags.resetC();
+    cpu.reg.flags.afterOr(result);
 
     lhs = result;
 }
 
 inline void xor_(u8& lhs, u8 rhs, CPU& cpu) {
     const u8 result = lhs ^ rhs;
-    result == 0 ? cpu.reg.flags.setZ() : cpu.reg.flags.resetZ();
-    cpu.reg.flags.resetN();
-    cpu.reg.flags.resetH();
-    cpu.reg.flags.resetC();
+    cpu.reg.flags.afterOr(result);
 
     lhs = result;
 }
@@ -136,56 +115,29 @@ inline void swapNybbles(u8& n, CPU& cpu) {
     const u8 lower = n & 0b0000'1111;
     const u8 result = u8(upper >> 4) | u8(lower << 4);
 
-    result == 0 ? cpu.reg.flags.setZ() : cpu.reg.flags.resetZ();
-    cpu.reg.flags.resetN();
-    cpu.reg.flags.resetH();
-    cpu.reg.flags.resetC();
+    // same flags as OR
+    cpu.reg.flags.afterOr(result);
 
     n = result;
 }
 
 inline void cp(u8 lhs, u8 rhs, CPU& cpu) {
-    if (lhs == rhs) {
-        cpu.reg.flags.setZ();
-        cpu.reg.flags.resetH();
-        cpu.reg.flags.resetC();
-    } else {
-        cpu.reg.flags.resetZ();
-
-        lhs < rhs ? cpu.reg.flags.setC() : cpu.reg.flags.resetC();
-        const u8 noBorrow = lhs ^ rhs;
-        const u8 diff = lhs - rhs;
-        const u8 borrowResult = noBorrow ^ diff;
-        const auto halfCarry = borrowResult & 0b0001'0000;
-        halfCarry ? cpu.reg.flags.setH() : cpu.reg.flags.resetH();
-    }
-    cpu.reg.flags.setN();
+    // a SUB that discards its result
+    cpu.reg.flags.afterSub(lhs, rhs, u8(lhs - rhs));
 }
 
 inline void inc(u8& operand, CPU& cpu) {
-    using namespace bitwise;
-
     const u8 result = operand + 1;
-    const auto halfCarry = test<4>(result) ^ test<4>(operand);
-
-    result == 0 ? cpu.reg.flags.setZ() : cpu.reg.flags.resetZ();
-    cpu.reg.flags.resetN();
-    halfCarry ? cpu.reg.flags.setH() : cpu.reg.flags.resetH();
     // C not affected
+    cpu.reg.flags.afterInc(result);
 
     operand = result;
 }
 
 inline void dec(u8& operand, CPU& cpu) {
-    using namespace bitwise;
-
     const u8 result = operand - 1;
-    const bool halfCarry = test<4>(result) ^ test<4>(operand);
-
-    result == 0 ? cpu.reg.flags.setZ() : cpu.reg.flags.resetZ();
-    cpu.reg.flags.setN();
-    halfCarry ? cpu.reg.flags.setH() : cpu.reg.flags.resetH();
     // C not affected
+    cpu.reg.flags.afterDec(result);
 
     operand = result;
 }
@@ -0,0 +1,368 @@
+#include "block_cache.hpp"
+
+#include "cpu.hpp"
+#include "mem.hpp"
+
+#if GEM_JIT
+#include "jit.hpp"
+#endif
+
+namespace gem {
+
+namespace {
+constexpr u8 PrefixCB = 0xCB;
+
+#if GEM_JIT
+// how often a block has to run before it's worth compiling
+constexpr u32 JITThreshold = 16;
+#endif
+
+bool cacheable(const Mem& mem, const u16 pc) {
+    const usize page = pc >> 8u;
+    // echo RAM and OAM/unusable memory are left to the interpreter
+    if (0xE0 <= page && page <= 0xFE) {
+        return false;
+    }
+    if (page == 0xFF) {
+        return pc >= 0xFF80;
+    }
+    return mem.readPage(page) != nullptr;
+}
+}  // namespace
+
+BlockCache::BlockCache(Mem& mem)
+    : mem{mem}
+#if GEM_JIT
+    , jit{}
+#endif
+{
+}
+BlockCache::~BlockCache() = default;
+
+void BlockCache::setJITEnabled(const bool enabled) {
+#if GEM_JIT
+    jitEnabled = enabled;
+    if (enabled && jit == nullptr) {
+        jit = std::make_unique<JIT>();
+    }
+#else
+    GEM_ASSERT(!enabled);
+    (void)enabled;
+#endif
+}
+
+DeltaTicks BlockCache::run(CPU& cpu, const Ticks budget) {
+    retired.clear();
+    // memory may have changed since the last run()
+    lastLoop.block = nullptr;
+    parked = false;
+#if GEM_JIT
+    // compiled code has the hook built in
+    if (jitEnabled && (cpu.getInstructionHook() != jitHook ||
+                       cpu.getInstructionHookContext() != jitHookContext)) {
+        forgetNativeCode();
+        jitHook = cpu.getInstructionHook();
+        jitHookContext = cpu.getInstructionHookContext();
+    }
+#endif
+    DeltaTicks elapsed = 0;
+    for (;;) {
+        Block* const block =
+              cpu.isRunning() && !cpu.hasHaltBug() ? lookup(cpu.reg.getPC())
+                                                   : nullptr;
+        if (block == nullptr) {
+            lastLoop.block = nullptr;
+            cpu.execute(budget - elapsed);
+            cpu.afterInstruction();
+            if (!cpu.continueRun(elapsed, budget)) {
+                return elapsed;
+            }
+            continue;
+        }
+
+        // if the whole block fits in the budget, checking for interrupts
+        // once at its end is enough: within a block they can only be
+        // raised by an IO write, which ends run() anyway, and IME only
+        // changes at the end of a block.
+        stale = false;
+        const bool fits =
+              elapsed + block->maxTicks < budget && !cpu.imePending();
+#if GEM_JIT
+        if (jitEnabled && block->native == nullptr &&
+            ++block->runs >= JITThreshold) {
+            block->native = compile(cpu, *block);
+        }
+        // compiled code checks the budget after every instruction, so it
+        // runs whether the block fits or not. it only looks for IO writes
+        // it makes itself, though, and one left over from the end of the
+        // last run() stops this one after an instruction.
+        if (jitEnabled && block->native != nullptr && !cpu.imePending() &&
+            !cpu.bus.ioWritePending()) {
+            const u16 start = cpu.reg.getPC();
+            const DeltaTicks before = elapsed;
+            elapsed += block->native(budget - elapsed);
+            // in continueRun()'s order
+            if (elapsed >= budget || cpu.bus.consumeIOWrite()) {
+                return elapsed;
+            }
+            cpu.processInterrupts();
+            if (fits && block->pure && !stale &&
+                cpu.reg.getPC() == start) {
+                if (enterIdleLoop(cpu, *block, elapsed - before)) {
+                    return elapsed;
+                }
+            } else {
+                lastLoop.block = nullptr;
+            }
+            continue;
+        }
+#endif
+        if (fits) {
+            const u16 start = cpu.reg.getPC();
+            const DeltaTicks before = elapsed;
+            const auto& ops = cpu.getInstructionHook() == nullptr
+                                    ? block->fused
+                                    : block->ops;
+            for (const MicroOp& op : ops) {
+                cpu.reg.setPC(op.nextPC);
+                cpu.retire(op.exec(cpu, op.operand));
+                cpu.afterInstruction();
+                elapsed += cpu.getDeltaTicks();
+                if (cpu.bus.consumeIOWrite()) {
+                    return elapsed;
+                }
+                if (stale) {
+                    break;
+                }
+            }
+            cpu.processInterrupts();
+            if (block->pure && !stale && cpu.reg.getPC() == start) {
+                if (enterIdleLoop(cpu, *block, elapsed - before)) {
+                    return elapsed;
+                }
+            } else {
+                lastLoop.block = nullptr;
+            }
+            continue;
+        }
+
+        lastLoop.block = nullptr;
+        for (const MicroOp& op : block->ops) {
+            cpu.reg.setPC(op.nextPC);
+            cpu.retire(op.exec(cpu, op.operand));
+            cpu.afterInstruction();
+            if (!cpu.continueRun(elapsed, budget)) {
+                return elapsed;
+            }
+            if (stale) {
+                break;
+            }
+        }
+    }
+}
+
+void BlockCache::invalidatePage(const usize page) {
+    for (auto it = pages.begin(); it != pages.end();) {
+        if ((it->first & 0xFF) == page) {
+            retired.push_back(std::move(it->second));
+            it = pages.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    current[page] = nullptr;
+    stale = true;
+}
+
+BlockCache::Block* BlockCache::lookup(const u16 pc) {
+    const usize page = pc >> 8u;
+    CodePage* cp = current[page];
+    if (cp == nullptr || currentData[page] != mem.readPage(page)) {
+        if (!cacheable(mem, pc)) {
+            return nullptr;
+        }
+        cp = codePage(page);
+    }
+    std::unique_ptr<Block>& block = cp->blocks[pc & 0xFF];
+    if (block == nullptr) {
+        block = decode(pc);
+        if (pc >= 0x8000 && !block->ops.empty()) {
+            mem.watchCode(pc, u16(block->ops.back().nextPC - 1));
+        }
+    }
+    return block->ops.empty() ? nullptr : block.get();
+}
+
+BlockCache::CodePage* BlockCache::codePage(const usize page) {
+    const usize key = (mem.bankAt(u16(page << 8u)) << 8u) | page;
+    std::unique_ptr<CodePage>& cp = pages[key];
+    if (cp == nullptr) {
+        cp = std::make_unique<CodePage>();
+    }
+    current[page] = cp.get();
+    currentData[page] = mem.readPage(page);
+    return cp.get();
+}
+
+#if GEM_JIT
+BlockCache::NativeBlock BlockCache::compile(CPU& cpu, const Block& block) {
+    const u16 start = cpu.reg.getPC();
+    if (NativeBlock native =
+              jit->compile(cpu, stale, start, block.ops, block.infos)) {
+        return native;
+    }
+    // out of code space: start over
+    forgetNativeCode();
+    return jit->compile(cpu, stale, start, block.ops, block.infos);
+}
+
+void BlockCache::forgetNativeCode() {
+    jit->flush();
+    for (auto& [key, cp] : pages) {
+        for (auto& b : cp->blocks) {
+            if (b != nullptr) {
+                b->native = nullptr;
+                b->runs = 0;
+            }
+        }
+    }
+}
+#endif
+
+bool BlockCache::enterIdleLoop(CPU& cpu,
+                               const Block& block,
+                               const DeltaTicks iteration) {
+    const auto& reg = cpu.reg;
+    const LoopState state{&block,      iteration,   reg.getAF(), reg.getBC(),
+                          reg.getDE(), reg.getHL(), reg.getSP()};
+    // the trace would be missing every skipped iteration
+    if (!(state == lastLoop) || cpu.getInstructionHook() != nullptr ||
+        idleLoopOverrides.disabled ||
+        idleLoopOverrides.ignored.contains(reg.getPC())) {
+        lastLoop = state;
+        return false;
+    }
+
+    // go round once more on a copy of the CPU to see what the loop reads
+    loop.iteration = iteration;
+    loop.reads.clear();
+    CPU copy{cpu.bus};
+    copy.reg = cpu.reg;
+    for (const MicroOp& op : block.ops) {
+        const auto& r = copy.reg;
+        switch (op.reads) {
+            case op::Reads::Nothing:
+                break;
+            case op::Reads::BC:
+                loop.reads.push_back(r.getBC());
+                break;
+            case op::Reads::DE:
+                loop.reads.push_back(r.getDE());
+                break;
+            case op::Reads::HL:
+                loop.reads.push_back(r.getHL());
+                break;
+            case op::Reads::Operand:
+                loop.reads.push_back(op.operand);
+                break;
+            case op::Reads::HighC:
+                loop.reads.push_back(u16(0xFF00 + r.getC()));
+                break;
+            case op::Reads::HighOperand:
+                loop.reads.push_back(u16(0xFF00 + op.operand));
+                break;
+            case op::Reads::Stack:
+                loop.reads.push_back(r.getSP());
+                loop.reads.push_back(u16(r.getSP() + 1));
+                break;
+        }
+        copy.reg.setPC(op.nextPC);
+        op.exec(copy, op.operand);
+    }
+    parked = true;
+    return true;
+}
+
+std::unique_ptr<BlockCache::Block> BlockCache::decode(const u16 pc) const {
+    auto block = std::make_unique<Block>();
+    const usize page = pc >> 8u;
+    usize address = pc;
+    for (;;) {
+        const op::DecodeInfo* info = &op::decodeTable[mem.read(u16(address))];
+        usize length = 1;
+        if (mem.read(u16(address)) == PrefixCB) {
+            if (((address + 1) >> 8u) != page) {
+                break;
+            }
+            info = &op::decodeTable_0xCB[mem.read(u16(address + 1))];
+            length = 2;
+        }
+        length += info->operandBytes;
+        if (info->exec == nullptr || ((address + length - 1) >> 8u) != page) {
+            break;
+        }
+
+        u16 operand = 0;
+        if (info->operandBytes == 1) {
+            operand = mem.read(u16(address + length - 1));
+        } else if (info->operandBytes == 2) {
+            operand = u16(mem.read(u16(address + length - 2)) |
+                          (mem.read(u16(address + length - 1)) << 8u));
+        }
+        block->ops.push_back(MicroOp{info->exec, operand,
+                                     u16(address + length), info->reads});
+#if GEM_JIT
+        block->infos.push_back(info);
+#endif
+        block->maxTicks += info->maxTicks;
+        block->pure = block->pure && info->pure;
+        address += length;
+        if (info->endsBlock) {
+            break;
+        }
+    }
+    block->fused = fuse(block->ops);
+    return block;
+}
+
+std::vector<BlockCache::MicroOp> BlockCache::fuse(
+      const std::vector<MicroOp>& ops) {
+    std::vector<MicroOp> fused;
+    for (usize i = 0; i < ops.size();) {
+        // the longest fusion that matches here
+        const op::Fusion* best = nullptr;
+        usize bestLength = 1;
+        for (const op::Fusion& f : op::fusions) {
+            usize length = 0;
+            while (length < f.parts.size() && f.parts[length] != nullptr &&
+                   i + length < ops.size() &&
+                   ops[i + length].exec == f.parts[length]) {
+                ++length;
+            }
+            const bool complete =
+                  length == f.parts.size() || f.parts[length] == nullptr;
+            if (complete && length > bestLength) {
+                best = &f;
+                bestLength = length;
+            }
+        }
+        if (best == nullptr) {
+            fused.push_back(ops[i]);
+            ++i;
+            continue;
+        }
+        u16 operand = 0;
+        unsigned shift = 0;
+        for (usize k = 0; k < bestLength; ++k) {
+            operand = u16(operand | (ops[i + k].operand << shift));
+            shift += 8u * best->operandBytes[k];
+        }
+        fused.push_back(MicroOp{best->exec, operand,
+                                ops[i + bestLength - 1].nextPC,
+                                op::Reads::Nothing});
+        i += bestLength;
+    }
+    return fused;
+}
+
+}  // namespace gem
@@ -0,0 +1,150 @@
+#ifndef GEM_BLOCK_CACHE_HPP
+#define GEM_BLOCK_CACHE_HPP
+
+#include "fwd.hpp"
+
+#include "idle_loops.hpp"
+#include "opcode.hpp"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace gem {
+
+struct CPU;
+struct JIT;
+struct Mem;
+
+// straight-line runs of instructions, decoded once into micro-ops with their
+// operands already extracted. blocks are keyed by (bank, PC) and never cross
+// a 256-byte page, so code in RAM can be invalidated a page at a time when
+// it's written to.
+struct BlockCache {
+    struct MicroOp {
+        op::ExecFn exec;
+        u16 operand;
+        u16 nextPC;
+        op::Reads reads;
+    };
+
+    // a loop the CPU is stuck in until something it reads changes: a pure
+    // block that jumps back to its own start and leaves the registers the
+    // way it found them. run() stops at the top of such a loop, and until
+    // leaveIdleLoop() the CPU is known to just go round it every `iteration`
+    // ticks.
+    struct IdleLoop {
+        DeltaTicks iteration = 0;
+        std::vector<u16> reads = {};
+    };
+
+    // a block compiled to host code. runs the block up to its end, an IO
+    // write or invalidation, or the first instruction that spends what's
+    // left of `budget`, like continueRun(), and returns the ticks that
+    // elapsed. a block that jumps back to its start may go round again.
+    using NativeBlock = DeltaTicks (*)(DeltaTicks budget);
+
+    explicit BlockCache(Mem& mem);
+    ~BlockCache();
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    // CPU::run, but running cached blocks wherever possible
+    DeltaTicks run(CPU& cpu, Ticks budget);
+
+    // code somewhere in `page` was overwritten
+    void invalidatePage(usize page);
+
+    // compile blocks that run often to host code. only available when
+    // built with GEM_JIT.
+    void setJITEnabled(bool enabled);
+
+    // null unless the last run() stopped in an idle loop
+    const IdleLoop* idleLoop() const { return parked ? &loop : nullptr; }
+    void leaveIdleLoop() { parked = false; }
+
+    void setIdleLoopOverrides(IdleLoopOverrides overrides) {
+        idleLoopOverrides = std::move(overrides);
+    }
+
+   private:
+    struct Block {
+        std::vector<MicroOp> ops = {};
+        // the same, with runs of ops fused where possible. only for running
+        // whole blocks: fused ops don't stop in between for the budget or
+        // an instruction hook.
+        std::vector<MicroOp> fused = {};
+        DeltaTicks maxTicks = 0;
+        bool pure = true;
+#if GEM_JIT
+        // what each of `ops` was decoded from
+        std::vector<const op::DecodeInfo*> infos = {};
+        u32 runs = 0;
+        NativeBlock native = nullptr;
+#endif
+    };
+
+    struct CodePage {
+        std::array<std::unique_ptr<Block>, 0x100> blocks = {};
+    };
+
+    // null if PC isn't in cacheable memory or the block would be empty, in
+    // which case the instruction is interpreted instead
+    Block* lookup(u16 pc);
+    CodePage* codePage(usize page);
+    std::unique_ptr<Block> decode(u16 pc) const;
+    static std::vector<MicroOp> fuse(const std::vector<MicroOp>& ops);
+#if GEM_JIT
+    NativeBlock compile(CPU& cpu, const Block& block);
+    void forgetNativeCode();
+#endif
+    // called after `block` ran for `iteration` ticks and jumped back to its
+    // own start. returns whether the CPU is now parked in an idle loop.
+    bool enterIdleLoop(CPU& cpu, const Block& block, DeltaTicks iteration);
+
+    Mem& mem;
+
+    // keyed by (bank << 8) | page
+    std::unordered_map<usize, std::unique_ptr<CodePage>> pages = {};
+
+    // the code page currently mapped at each page, valid as long as the
+    // memory it was decoded from is still mapped there
+    std::array<CodePage*, 0x100> current = {};
+    std::array<const u8*, 0x100> currentData = {};
+
+    // invalidated pages can't be freed while one of their blocks runs
+    std::vector<std::unique_ptr<CodePage>> retired = {};
+    bool stale = false;
+
+    // the registers after the last run of a block that jumped back to its
+    // own start. seeing the same twice in a row means it's an idle loop.
+    struct LoopState {
+        const Block* block = nullptr;
+        DeltaTicks iteration = 0;
+        u16 af = 0, bc = 0, de = 0, hl = 0, sp = 0;
+
+        bool operator==(const LoopState& o) const {
+            return block == o.block && iteration == o.iteration &&
+                   af == o.af && bc == o.bc && de == o.de && hl == o.hl &&
+                   sp == o.sp;
+        }
+    };
+    LoopState lastLoop = {};
+    IdleLoop loop = {};
+    bool parked = false;
+    IdleLoopOverrides idleLoopOverrides = {};
+
+#if GEM_JIT
+    std::unique_ptr<JIT> jit;
+    bool jitEnabled = false;
+    // the instruction hook the compiled code calls
+    void (*jitHook)(void* context, const CPU& cpu) = nullptr;
+    void* jitHookContext = nullptr;
+#endif
+};
+
+}  // namespace gem
+
+#endif
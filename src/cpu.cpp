@@ -1,5 +1,8 @@
 #include "cpu.hpp"
 
+#include "block_cache.hpp"
+#include "profiler.hpp"
+
 #ifndef NDEBUG
 #define GEM_DEBUG_STACK false
 #endif
@@ -9,6 +12,19 @@
 static std::stack<gem::u16> debugStack;
 #endif
 
+#if GEM_PROFILE
+#define GEM_PROFILE_NOTIFY(...)    \
+    do {                           \
+        if (profiler != nullptr) { \
+            profiler->__VA_ARGS__; \
+        }                          \
+    } while (false)
+#else
+#define GEM_PROFILE_NOTIFY(...) \
+    do {                        \
+    } while (false)
+#endif
+
 #if GEM_DEBUG_STACK
 #define GEM_DEBUG_PUSH_STACK(...)       \
     do {                                \
@@ -29,6 +45,7 @@ void gem::CPU::pushStack(gem::u16 val) {
     bus.write(reg.getSP(), low8);
 
     GEM_DEBUG_PUSH_STACK(val);
+    GEM_PROFILE_NOTIFY(pushed());
 }
 #undef GEM_DEBUG_PUSH_STACK
 
@@ -54,12 +71,37 @@ gem::u16 gem::CPU::popStack() {
     const u16 val = u16(high8 << 8u) | u16(low8);
 
     GEM_DEBUG_POP_STACK(val);
+    GEM_PROFILE_NOTIFY(popped());
     return val;
 }
 #undef GEM_DEBUG_POP_STACK
 
 namespace gem {
 
+#if GEM_PROFILE
+void CPU::setProfiler(Profiler* const p) {
+    profiler = p;
+    setInstructionHook(p != nullptr ? &Profiler::record : nullptr, p);
+}
+#endif
+
+DeltaTicks CPU::run(const Ticks budget) {
+    if (blockCache != nullptr) {
+        return blockCache->run(*this, budget);
+    }
+#if GEM_THREADED_DISPATCH
+    if (instructionHook == nullptr) {
+        return op::runThreaded(*this, budget);
+    }
+#endif
+    DeltaTicks elapsed = 0;
+    do {
+        execute(budget - elapsed);
+        afterInstruction();
+    } while (continueRun(elapsed, budget));
+    return elapsed;
+}
+
 u8 CPU::getPendingInterrupts() const {
     return bus.interruptFlags.getMasked() & bus.enabledInterrupts.getMasked();
 }
@@ -70,6 +112,7 @@ void CPU::processInterrupts() {
         if (const u8 interruptsThatOccurred = getPendingInterrupts()) {
             halted = false;
             stopped = false;
+            GEM_PROFILE_NOTIFY(woke());
             if (ime) {
                 const auto& interrupts = Interrupt::bitAndHandlerPairs;
                 for (auto& bhp : interrupts) {
@@ -97,6 +140,7 @@ void CPU::handleInterrupt(const u16 destination) {
 
     pushStack(reg.getPC());
     reg.setPC(destination);
+    GEM_PROFILE_NOTIFY(interrupted(destination));
 }
 
 void CPU::returnFromInterrupt() {
@@ -105,3 +149,5 @@ void CPU::returnFromInterrupt() {
 }
 
 }  // namespace gem
+
+#undef GEM_PROFILE_NOTIFY
@@ -12,54 +12,176 @@
 
 namespace gem {
 
+struct BlockCache;
+struct Profiler;
+
+// the ALU records its last operation and operands instead of computing
+// every flag, since the next instruction usually overwrites them anyway.
+// flags are worked out from that record only when something reads them,
+// and it's folded back into the plain register before individual bits are
+// changed.
 struct FlagRegister {
-    bool getZ() const { return get<7>(); }
+    bool getZ() const {
+        return lazy != Lazy::None ? lazyResult == 0 : get<7>();
+    }
     void setZ() { set<7>(); }
     void toggleZ() { toggle<7>(); }
     void resetZ() { reset<7>(); }
 
-    bool getN() const { return get<6>(); }
+    bool getN() const {
+        switch (lazy) {
+            case Lazy::None:
+                return get<6>();
+            case Lazy::Sub:
+            case Lazy::Dec:
+                return true;
+            case Lazy::Add:
+            case Lazy::And:
+            case Lazy::Or:
+            case Lazy::Inc:
+                return false;
+        }
+        GEM_UNREACHABLE();
+    }
     void setN() { set<6>(); }
     void toggleN() { toggle<6>(); }
     void resetN() { reset<6>(); }
 
-    bool getH() const { return get<5>(); }
+    bool getH() const {
+        switch (lazy) {
+            case Lazy::None:
+                return get<5>();
+            case Lazy::Add:
+                return (lazyLhs & 0xF) + (lazyRhs & 0xF) > 0xF;
+            case Lazy::Sub:
+                return (lazyLhs & 0xF) < (lazyRhs & 0xF);
+            case Lazy::And:
+                return true;
+            case Lazy::Or:
+                return false;
+            case Lazy::Inc:
+                return (lazyResult & 0xF) == 0x0;
+            case Lazy::Dec:
+                return (lazyResult & 0xF) == 0xF;
+        }
+        GEM_UNREACHABLE();
+    }
     void setH() { set<5>(); }
     void toggleH() { toggle<5>(); }
     void resetH() { reset<5>(); }
 
-    bool getC() const { return get<4>(); }
+    bool getC() const {
+        switch (lazy) {
+            case Lazy::None:
+            case Lazy::Inc:
+            case Lazy::Dec:
+                return get<4>();
+            case Lazy::Add:
+                return lazyResult < lazyLhs;
+            case Lazy::Sub:
+                return lazyLhs < lazyRhs;
+            case Lazy::And:
+            case Lazy::Or:
+                return false;
+        }
+        GEM_UNREACHABLE();
+    }
     void setC() { set<4>(); }
     void toggleC() { toggle<4>(); }
     void resetC() { reset<4>(); }
 
-    void set(const u8 val) { r = val & 0xF0; }
-    u8 get() const noexcept { return r; }
+    void set(const u8 val) {
+        lazy = Lazy::None;
+        r = val & 0xF0;
+    }
+    u8 get() const noexcept {
+        if (lazy == Lazy::None) {
+            return r;
+        }
+        return u8(getZ() << 7u | getN() << 6u | getH() << 5u | getC() << 4u);
+    }
+    void assign(const bool z, const bool n, const bool h, const bool c) {
+        lazy = Lazy::None;
+        r = u8(z << 7u | n << 6u | h << 5u | c << 4u);
+    }
+
+    // lazily computed results of 8-bit ALU operations
+    void afterAdd(const u8 lhs, const u8 rhs, const u8 result) {
+        record(Lazy::Add, lhs, rhs, result);
+    }
+    // also CP
+    void afterSub(const u8 lhs, const u8 rhs, const u8 result) {
+        record(Lazy::Sub, lhs, rhs, result);
+    }
+    void afterAnd(const u8 result) { record(Lazy::And, 0, 0, result); }
+    // also XOR and SWAP
+    void afterOr(const u8 result) { record(Lazy::Or, 0, 0, result); }
+    // C isn't affected, so it's carried over into the plain register
+    void afterInc(const u8 result) {
+        r = u8(getC() << 4u);
+        record(Lazy::Inc, 0, 0, result);
+    }
+    void afterDec(const u8 result) {
+        r = u8(getC() << 4u);
+        record(Lazy::Dec, 0, 0, result);
+    }
 
    private:
+    friend struct JIT;
+
+    enum class Lazy : u8 {
+        None,  // r holds every flag
+        Add,
+        Sub,
+        And,
+        Or,
+        Inc,  // r holds C
+        Dec,  // r holds C
+    };
+
+    void record(const Lazy op, const u8 lhs, const u8 rhs, const u8 result) {
+        lazy = op;
+        lazyLhs = lhs;
+        lazyRhs = rhs;
+        lazyResult = result;
+    }
+    void materialize() {
+        if (lazy != Lazy::None) {
+            r = get();
+            lazy = Lazy::None;
+        }
+    }
+
     template <unsigned Bit>
     bool get() const {
         return bitwise::test<Bit>(r);
     }
     template <unsigned Bit>
     void set() {
+        materialize();
         bitwise::set<Bit>(r);
     }
     template <unsigned Bit>
     void toggle() {
+        materialize();
         bitwise::toggle<Bit>(r);
     }
     template <unsigned Bit>
     void reset() {
+        materialize();
         bitwise::reset<Bit>(r);
     }
     u8 r = 0;
+    Lazy lazy = Lazy::None;
+    u8 lazyLhs = 0;
+    u8 lazyRhs = 0;
+    u8 lazyResult = 0;
 };
 
 struct Registers {
 #define REGISTER_GET_SET(FIRST, SECOND)                       \
    private:                                                   \
-    u8 FIRST, SECOND;                                         \
+    u8 FIRST = 0, SECOND = 0;                                 \
                                                               \
    public:                                                    \
     void set##FIRST(const u8 val) noexcept { FIRST = val; }   \
@@ -70,7 +192,7 @@ struct Registers {
     u8& get##SECOND##Mut() noexcept { return SECOND; }
 
    private:
-    u8 A;
+    u8 A = 0;
 
    public:
     FlagRegister flags;
@@ -124,6 +246,7 @@ struct Registers {
     void incPC(const i8 val) { PC += val; }
 
     friend struct CPU;
+    friend struct JIT;
 
 #undef REGISTER_PAIR
 #undef REGISTER_GET_SET
@@ -132,19 +255,82 @@ struct Registers {
 struct CPU {
     explicit CPU(Mem& in_bus) : bus{in_bus} {}
 
+    // when set, run() executes cached blocks instead of interpreting every
+    // instruction
+    void setBlockCache(BlockCache* const cache) { blockCache = cache; }
+
+    // called after every instruction, for differential testing. every mode
+    // honours it, at some cost; set it before running anything.
+    using InstructionHook = void (*)(void* context, const CPU& cpu);
+    void setInstructionHook(const InstructionHook hook, void* const context) {
+        instructionHook = hook;
+        instructionHookContext = context;
+    }
+    InstructionHook getInstructionHook() const { return instructionHook; }
+    void* getInstructionHookContext() const { return instructionHookContext; }
+#if GEM_PROFILE
+    // counts where emulated time goes. takes the instruction hook.
+    void setProfiler(Profiler* profiler);
+#endif
+    void afterInstruction() const {
+        if (instructionHook != nullptr) {
+            instructionHook(instructionHookContext, *this);
+        }
+    }
+
     Registers reg;
     Mem& bus;
 
-    void execute() {
-        if (!stopped && !halted) {
-            deltaTicks = op::runOpcode(readPC(), *this);
-            ticks += deltaTicks;
+    // runs instructions until at least `budget` ticks have elapsed, or until
+    // an instruction writes to an IO register and may have rescheduled a
+    // device event. returns the number of ticks that actually elapsed.
+    DeltaTicks run(Ticks budget);
+
+    // runs one instruction. a halted or stopped CPU idles for up to
+    // `maxIdle` ticks instead.
+    void execute(const DeltaTicks maxIdle = IdleTicks) {
+        if (isRunning()) {
+            retire(op::runOpcode(readPC(), *this));
+        } else {
+            idle(maxIdle);
         }
+    }
+
+    bool isRunning() const { return !stopped && !halted; }
+    bool hasHaltBug() const { return haltBug; }
+    bool imePending() const { return pendingIME; }
+    // whether processInterrupts() would jump to a handler
+    bool interruptDue() const { return ime && getPendingInterrupts() != 0; }
+    // nothing can wake a halted or stopped CPU but an interrupt, and those
+    // are only raised by device events, which never happen inside run(). so
+    // idling skips straight to the end of the budget, in whole IdleTicks
+    // steps to land on the same tick as waiting step by step would.
+    void idle(const DeltaTicks maxIdle) {
+        retire((maxIdle + IdleTicks - 1) / IdleTicks * IdleTicks);
+    }
+
+    // bookkeeping after every instruction
+    void retire(const DeltaTicks delta) {
+        deltaTicks = delta;
+        ticks += delta;
+        applyPendingIME();
+    }
+    void applyPendingIME() {
         if (pendingIME) {
             ime = true;
             pendingIME = false;
         }
     }
+    // called between the instructions of run(). returns whether to keep
+    // going.
+    bool continueRun(DeltaTicks& elapsed, const Ticks budget) {
+        elapsed += deltaTicks;
+        if (elapsed >= budget || bus.consumeIOWrite()) {
+            return false;
+        }
+        processInterrupts();
+        return true;
+    }
     u8 readPC() {
         const auto ret = peekPC();
         if (!haltBug) {
@@ -167,6 +353,7 @@ struct CPU {
     }
 
     Ticks getTicks() const { return ticks; }
+    const Ticks& clock() const { return ticks; }
     DeltaTicks getDeltaTicks() const { return deltaTicks; }
 
     void ei() { pendingIME = true; }
@@ -184,6 +371,18 @@ struct CPU {
     }
 
    private:
+    friend struct JIT;
+
+    // how long a halted or stopped CPU waits before checking for interrupts
+    static constexpr DeltaTicks IdleTicks = 4;
+
+    BlockCache* blockCache = nullptr;
+    InstructionHook instructionHook = nullptr;
+    void* instructionHookContext = nullptr;
+#if GEM_PROFILE
+    Profiler* profiler = nullptr;
+#endif
+
     Ticks ticks = 0;
     DeltaTicks deltaTicks = 0;
     bool ime = false;
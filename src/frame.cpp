@@ -0,0 +1,77 @@
+#include "frame.hpp"
+
+#include "pixels.hpp"
+
+namespace gem {
+
+namespace {
+// the grey level of each shade
+constexpr std::array<u8, 4> Levels = {0xFF, 0xAA, 0x55, 0x00};
+
+u32 hostPixel(const Frame::Format format, const u8 shade) {
+    const u32 level = Levels[shade];
+    switch (format) {
+        case Frame::Format::RGBA8888:
+            return level | (level << 8u) | (level << 16u) | 0xFF000000u;
+        case Frame::Format::RGB565:
+            return ((level >> 3u) << 11u) | ((level >> 2u) << 5u) |
+                   (level >> 3u);
+        case Frame::Format::Grey8:
+            return level;
+    }
+    GEM_UNREACHABLE();
+}
+}  // namespace
+
+unsigned Frame::bytesPerPixel(const Format format) {
+    switch (format) {
+        case Format::RGBA8888:
+            return 4;
+        case Format::RGB565:
+            return 2;
+        case Format::Grey8:
+            return 1;
+    }
+    GEM_UNREACHABLE();
+}
+
+const char* Frame::name(const Format format) {
+    switch (format) {
+        case Format::RGBA8888:
+            return "rgba8888";
+        case Format::RGB565:
+            return "rgb565";
+        case Format::Grey8:
+            return "grey8";
+    }
+    GEM_UNREACHABLE();
+}
+
+u8 Frame::shade(const unsigned y, const u8 pixel) const {
+    const Palettes& p = palettes[y];
+    const u8 palette = pixel >= Sprite1   ? p.obp1
+                       : pixel >= Sprite0 ? p.obp0
+                                          : p.bgp;
+    return (palette >> ((pixel & 0b11u) * 2u)) & 0b11u;
+}
+
+void Frame::convertLine(const unsigned y, const Format format, u8* out) const {
+    const unsigned bytes = bytesPerPixel(format);
+    // every pixel this line can have, as `format`. the entries for the
+    // fourth source are never looked up.
+    std::array<u8, 16 * 4> table = {};
+    for (unsigned pixel = 0; pixel < 12; ++pixel) {
+        const u32 host = hostPixel(format, shade(y, u8(pixel)));
+        std::memcpy(table.data() + pixel * bytes, &host, bytes);
+    }
+    pixels::lookup(line(y), Width, table.data(), bytes, out);
+}
+
+void Frame::convert(const Format format, u8* out) const {
+    const unsigned bytes = bytesPerPixel(format);
+    for (unsigned y = 0; y < Height; ++y) {
+        convertLine(y, format, out + y * Width * bytes);
+    }
+}
+
+}  // namespace gem
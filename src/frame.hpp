@@ -0,0 +1,58 @@
+#ifndef GEM_FRAME_HPP
+#define GEM_FRAME_HPP
+
+#include "fwd.hpp"
+
+#include "screen.hpp"
+
+#include <array>
+
+namespace gem {
+
+// a screenful of pixels as the GPU draws them, before they have colours: a
+// byte per pixel holding its colour code and the palette that goes through.
+// the palettes are kept for each line as they were when it was drawn, so
+// the whole frame can be converted to host pixels in one go once it's done.
+struct Frame {
+    static constexpr usize Width = Screen::Width, Height = Screen::Height;
+
+    // which palette a pixel's colour code goes through, in bits 2-3
+    enum Source : u8 {
+        Background = 0b0000,
+        Sprite0 = 0b0100,
+        Sprite1 = 0b1000,
+    };
+
+    // what a frame can be converted to: RGBA8888 is the bytes R, G, B, A in
+    // that order, RGB565 a little-endian u16 and Grey8 a single byte
+    enum class Format : u8 { RGBA8888, RGB565, Grey8 };
+    static unsigned bytesPerPixel(Format format);
+    static const char* name(Format format);
+
+    struct Palettes {
+        u8 bgp;
+        u8 obp0;
+        u8 obp1;
+    };
+
+    u8* line(const unsigned y) { return pixels.data() + y * Width; }
+    const u8* line(const unsigned y) const {
+        return pixels.data() + y * Width;
+    }
+    void setPalettes(const unsigned y, const Palettes& p) { palettes[y] = p; }
+
+    // the shade `pixel` on line `y` ends up as, from 0 (white) to 3 (black)
+    u8 shade(unsigned y, u8 pixel) const;
+
+    // line `y`, or the whole frame, as `format` pixels
+    void convertLine(unsigned y, Format format, u8* out) const;
+    void convert(Format format, u8* out) const;
+
+   private:
+    std::array<u8, Width * Height> pixels = {};
+    std::array<Palettes, Height> palettes = {};
+};
+
+}  // namespace gem
+
+#endif
@@ -25,6 +25,9 @@ inline bool ends_with(const char* str, const char val) {
 namespace {
 std::string makeAbsolute(std::string_view rel) {
     // TODO portability
+    if (util::starts_with(rel, '/')) {
+        return std::string{rel};
+    }
     const auto projectPath = fs::projectPath();
     const bool needsSlash =
           !(util::ends_with(projectPath, '/') || util::starts_with(rel, '/'));
@@ -1,6 +1,7 @@
 #ifndef GEM_FWD_HPP
 #define GEM_FWD_HPP
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <cstring>
@@ -77,11 +78,13 @@ namespace gem {
 using u8 = std::uint8_t;
 using u16 = std::uint16_t;
 using u32 = std::uint32_t;
+using u64 = std::uint64_t;
 using usize = std::size_t;
 
 using i8 = std::int8_t;
 using i16 = std::int16_t;
 using i32 = std::int32_t;
+using i64 = std::int64_t;
 
 using Ticks = unsigned long long;
 using DeltaTicks = unsigned long long;
@@ -178,7 +181,7 @@ class FlatSet {
     }
 
    private:
-    std::vector<T> storage;
+    std::vector<T> storage = {};
 };
 
 template <typename E>
@@ -0,0 +1,137 @@
+#include "gameboy.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace gem {
+
+namespace {
+// whether handling `event` can change what's at `address`
+bool changes(const Scheduler::Event event, const u16 address) {
+    switch (event) {
+        case Scheduler::Event::PPU:
+            return address == GPU::Registers::LY ||
+                   address == GPU::Registers::STAT ||
+                   address == Interrupt::Registers::IF;
+        case Scheduler::Event::DIV:
+            return address == IO::Registers::DIV;
+        case Scheduler::Event::TIMA:
+            return address == IO::Registers::TIMA ||
+                   address == Interrupt::Registers::IF;
+        case Scheduler::Event::Count:
+            break;
+    }
+    GEM_UNREACHABLE();
+}
+}  // namespace
+
+GameBoy::GameBoy(Mem::Block rom, Screen& screen)
+    : gpu{screen}
+    , io{}
+    , mem{std::move(rom), gpu, io}
+    , blockCache{mem}
+    , cpu{mem}
+    , scheduler{cpu.clock()} {
+    io.setMem(&mem);
+    io.setScheduler(&scheduler);
+    gpu.setMem(&mem);
+    gpu.setScheduler(&scheduler);
+    mem.setBlockCache(&blockCache);
+    setCPUMode(CPUMode::Blocks);
+}
+
+void GameBoy::setCPUMode(const CPUMode mode) {
+    switch (mode) {
+        case CPUMode::Interpreter:
+            cpu.setBlockCache(nullptr);
+            return;
+        case CPUMode::Blocks:
+            blockCache.setJITEnabled(false);
+            cpu.setBlockCache(&blockCache);
+            return;
+#if GEM_JIT
+        case CPUMode::JIT:
+            blockCache.setJITEnabled(true);
+            cpu.setBlockCache(&blockCache);
+            return;
+#endif
+    }
+    GEM_UNREACHABLE();
+}
+
+void GameBoy::step() {
+    const Ticks next = scheduler.nextEventTime();
+    if (blockCache.idleLoop() != nullptr && skipToEvent(next)) {
+        return;
+    }
+    if (next > getTicks()) {
+        cpu.run(next - getTicks());
+    }
+    while (const auto entry = scheduler.popDue()) {
+        handleEvent(*entry);
+    }
+    cpu.processInterrupts();
+}
+
+// with the CPU parked in an idle loop, there's no need to run it up to the
+// next event unless the event changes something the loop reads: only the
+// clock has to catch up, in whole iterations. returns false if the CPU has
+// to run normally instead.
+bool GameBoy::skipToEvent(const Ticks next) {
+    const BlockCache::IdleLoop& loop = *blockCache.idleLoop();
+    if (next == std::numeric_limits<Ticks>::max()) {
+        blockCache.leaveIdleLoop();
+        return false;
+    }
+    if (next > getTicks()) {
+        const DeltaTicks iteration = loop.iteration;
+        cpu.retire((next - getTicks()) / iteration * iteration);
+    }
+    const Scheduler::Event event = scheduler.peek()->event;
+    const auto changed = [&](const u16 address) {
+        return changes(event, address);
+    };
+    if (std::any_of(loop.reads.begin(), loop.reads.end(), changed)) {
+        blockCache.leaveIdleLoop();
+        return false;
+    }
+    u8& interruptFlags = *mem.interruptFlags.valPtr();
+    const u8 flagsBefore = interruptFlags;
+    handleEvent(scheduler.pop());
+    if (cpu.interruptDue()) {
+        // the CPU has to get to where it notices the interrupt. the event
+        // changed nothing the loop reads, so it can still run up to it after
+        // the fact, as long as it doesn't see the interrupt early.
+        blockCache.leaveIdleLoop();
+        if (next > getTicks()) {
+            const u8 flagsAfter = std::exchange(interruptFlags, flagsBefore);
+            cpu.run(next - getTicks());
+            interruptFlags = flagsAfter;
+        }
+        while (const auto entry = scheduler.popDue()) {
+            handleEvent(*entry);
+        }
+        cpu.processInterrupts();
+    }
+    return true;
+}
+
+void GameBoy::handleEvent(const Scheduler::Entry& entry) {
+    switch (entry.event) {
+        case Scheduler::Event::PPU:
+            gpu.handleEvent(entry.when);
+            return;
+        case Scheduler::Event::DIV:
+            io.handleDIVEvent(entry.when);
+            return;
+        case Scheduler::Event::TIMA:
+            io.handleTIMAEvent(entry.when);
+            return;
+        case Scheduler::Event::Count:
+            break;
+    }
+    GEM_UNREACHABLE();
+}
+
+}  // namespace gem
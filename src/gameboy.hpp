@@ -0,0 +1,53 @@
+#ifndef GEM_GAMEBOY_HPP
+#define GEM_GAMEBOY_HPP
+
+#include "block_cache.hpp"
+#include "cpu.hpp"
+#include "fwd.hpp"
+#include "gpu.hpp"
+#include "io.hpp"
+#include "mem.hpp"
+#include "scheduler.hpp"
+
+namespace gem {
+
+struct Screen;
+
+// the emulated machine minus its frontend. the frontend provides the Screen
+// (and, at link time, the Input implementation) and drives step().
+struct GameBoy {
+    explicit GameBoy(Mem::Block rom, Screen& screen);
+
+    GameBoy(const GameBoy&) = delete;
+    GameBoy& operator=(const GameBoy&) = delete;
+
+    void step();
+
+    Ticks getTicks() const { return cpu.getTicks(); }
+
+    // how the CPU runs code. all modes must behave identically, but only the
+    // block cache notices idle loops and can skip them. Blocks by default.
+    enum class CPUMode {
+        Interpreter,
+        Blocks,  // cached, pre-decoded blocks
+#if GEM_JIT
+        JIT,  // like Blocks, but compiling hot blocks to host code
+#endif
+    };
+    void setCPUMode(CPUMode mode);
+
+    GPU gpu;
+    IO io;
+    Mem mem;
+    BlockCache blockCache;
+    CPU cpu;
+    Scheduler scheduler;
+
+   private:
+    void handleEvent(const Scheduler::Entry& entry);
+    bool skipToEvent(Ticks next);
+};
+
+}  // namespace gem
+
+#endif
@@ -3,11 +3,18 @@
 #include "bitwise.hpp"
 #include "fs.hpp"
 #include "mem.hpp"
+#include "pixels.hpp"
+#include "scheduler.hpp"
 #include "screen.hpp"
 
+#include <algorithm>
 #include <array>
 #include <optional>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <fstream>
 #include <iostream>
 
@@ -32,55 +39,18 @@ constexpr auto Transparent = 0x00000000_argb;
 };  // namespace Colors
 }  // namespace
 
-GPU::Tile::Tile(const u8* const data) {
-    GEM_ASSERT(data != nullptr);
-    std::size_t pixelsIdx = 0;
-    for (std::size_t i = 0; i < 16; i += 2) {
-        const u8 first = data[i];
-        const u8 second = data[i + 1];
-        for (u8 b = 8; b > 0; --b) {
-            const u8 firstB = bitwise::test(first, b - 1);
-            const u8 secondB = bitwise::test(second, b - 1);
-            pixels[pixelsIdx] = ColorCode(u8(secondB << 1u) | firstB);
-            ++pixelsIdx;
-        }
-    }
-}
-
-GPU::CachedTile GPU::loadCachedTile(u16 address) const {
-    const auto tile = CachedTile{vramPtr(address)};
-    return tile;
-}
-
-void GPU::invalidateTileCacheForAddress(u16 address) {
-    address /= Tile::MemSize;
-    cachedTiles[address] = std::nullopt;
-}
-
 namespace {
-char dumpChar(const GPU::ColorCode cc) {
-    using CC = GPU::ColorCode;
-    switch (cc) {
-        case CC::C00:
-            return '_';
-        case CC::C11:
-            return '#';
-        case CC::C01:
-            return '|';
-        case CC::C10:
-            return '*';
-    }
-    GEM_UNREACHABLE();
-}
-void dumpTile(const GPU::Tile& tile) {
-    using Tile = GPU::Tile;
-    for (usize i = 0; i < Tile::Width * Tile::Height; ++i) {
-        auto& cc = tile.pixels[i];
-        GEM_LOG_EXACTLY(dumpChar(cc));
-        if ((i + 1) % Tile::Width == 0) {
-            GEM_LOG_EXACTLY('\n');
-        }
-    }
+// the colour code of pixel (x, y) of the tile at `tileAddress`, straight
+// from VRAM
+GPU::ColorCode tilePixel(const Mem::Block& vram,
+                         const u16 tileAddress,
+                         const unsigned x,
+                         const unsigned y) {
+    const u8 first = vram[tileAddress + y * 2];
+    const u8 second = vram[tileAddress + y * 2 + 1];
+    const u8 firstB = bitwise::test(first, 7 - x);
+    const u8 secondB = bitwise::test(second, 7 - x);
+    return GPU::ColorCode(u8(secondB << 1u) | firstB);
 }
 
 GPU::OAM loadOAMFromPtr(const u8* data) {
@@ -98,44 +68,114 @@ GPU::OAM loadOAMFromPtr(const u8* data) {
 
     return oam;
 }
-}  // namespace
 
-GPU::OAM GPU::loadCachedOAM(u16 address) const {
-    return loadOAMFromPtr(spriteDataPtr(address));
+
+// which of the sprites at `ys`, padded with zeroes, cover `line`: bit i is
+// set if sprite i does. a sprite covers the 8 lines from Y - 16, so `line`
+// + 16 - Y is below 8 exactly for those. that holds in 8-bit arithmetic too,
+// as the padding never does, so all 40 are compared a register at a time.
+u64 spritesCovering(const std::array<u8, 48>& ys, const unsigned line) {
+    u64 ret = 0;
+#if defined(__SSE2__)
+    const __m128i bottom = _mm_set1_epi8(char(line + 16));
+    const __m128i seven = _mm_set1_epi8(7);
+    for (unsigned i = 0; i < ys.size(); i += 16) {
+        const __m128i y =
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(&ys[i]));
+        const __m128i rows = _mm_sub_epi8(bottom, y);
+        const __m128i covered =
+              _mm_cmpeq_epi8(_mm_min_epu8(rows, seven), rows);
+        ret |= u64(unsigned(_mm_movemask_epi8(covered))) << i;
+    }
+#else
+    for (unsigned i = 0; i < ys.size(); ++i) {
+        if (u8(line + 16 - ys[i]) < 8) {
+            ret |= u64{1} << i;
+        }
+    }
+#endif
+    return ret;
 }
+}  // namespace
 
-void GPU::invalidateOAMCacheForAddress(u16 address) {
-    address /= GPU::SpriteData::OAMBlockSize;
-    cachedSprites[address] = std::nullopt;
+void GPU::Renderer::bucketSprites() {
+    std::array<u8, 48> ys = {};
+    for (usize i = 0; i < sprites.size(); ++i) {
+        const u8* const data = &spriteData.block[i * SpriteData::OAMBlockSize];
+        sprites[i] = loadOAMFromPtr(data);
+        ys[i] = data[0];
+    }
+    for (unsigned line = 0; line < lineSprites.size(); ++line) {
+        LineSprites& bucket = lineSprites[line];
+        bucket.count = 0;
+        const u64 covering = spritesCovering(ys, line);
+        for (u8 idx = 0;
+             idx < sprites.size() && bucket.count < LineSprites::Max; ++idx) {
+            if (((covering >> idx) & 1u) == 0) {
+                continue;
+            }
+            // by X, after any with the same X so those stay in OAM order
+            const u8 x = sprites[idx].screenPosXPlus8;
+            usize at = bucket.count++;
+            for (; at > 0 &&
+                   sprites[bucket.indices[at - 1]].screenPosXPlus8 > x;
+                 --at) {
+                bucket.indices[at] = bucket.indices[at - 1];
+            }
+            bucket.indices[at] = idx;
+        }
+    }
+    spritesStale = false;
 }
 
-void GPU::invalidateAllOAMCache() {
-    std::fill(cachedSprites.begin(), cachedSprites.end(), std::nullopt);
+const GPU::Renderer::LineSprites& GPU::Renderer::spritesOnCurrentLine() {
+    if (spritesStale) {
+        bucketSprites();
+    }
+    return lineSprites[currentLine];
 }
 
 GPU::GPU(Screen& screen)
-    : screen{screen}
-    , vram{Mem::makeBlock<0x8000, 0x9FFF>()}
-    , cachedTiles((TileSet0End - TileSet1Start) / Tile::MemSize, std::nullopt)
-    , cachedSprites(
-            (SpriteData::End - SpriteData::Start) / SpriteData::OAMBlockSize,
-            std::nullopt) {}
-
-void GPU::step(DeltaTicks deltaTicks) {
-    if (auto nextMode = std::visit(
-              [&](auto& mode) -> std::optional<Mode> {
-                  using ModeType = std::decay_t<decltype(mode)>;
-                  mode.timer += deltaTicks;
-                  mode.step(*this);
-                  if (mode.timer >= ModeType::Time) {
-                      return mode.nextMode(*this);
-                  }
-                  return std::nullopt;
-              },
-              mode)) {
-        mode = *std::move(nextMode);
-        updateSTAT();
+    : screen{screen}, vram{Mem::makeBlock<0x8000, 0x9FFF>()} {}
+
+GPU::~GPU() {
+    setRenderThread(false);
+}
+
+void GPU::setScheduler(Scheduler* const scheduler) {
+    this->scheduler = scheduler;
+    scheduler->schedule(Scheduler::Event::PPU,
+                        scheduler->now() + Mode_HBlank::Time);
+}
+
+void GPU::handleEvent(const Ticks when) {
+    GEM_ASSERT(scheduler != nullptr);
+    if (auto* const vblank = std::get_if<Mode_VBlank>(&mode)) {
+        // VBlank takes the same amount of time as 10 scanlines including
+        // HBlank, and LY keeps counting through it
+        static_assert(ScanlineTime == Mode_VBlank::Time / 10);
+        ++vblank->linesElapsed;
+        ++currentLine;
+        GEM_ASSERT(currentLine <= 154);
+        if (vblank->linesElapsed < Mode_VBlank::Time / ScanlineTime) {
+            scheduler->schedule(Scheduler::Event::PPU, when + ScanlineTime);
+            updateSTAT();
+            return;
+        }
     }
+    mode = std::visit([&](auto& m) { return m.nextMode(*this); }, mode);
+    const Ticks duration = std::visit(
+          [](auto& m) -> Ticks {
+              using ModeType = std::decay_t<decltype(m)>;
+              if constexpr (std::is_same_v<ModeType, Mode_VBlank>) {
+                  return ScanlineTime;
+              } else {
+                  return ModeType::Time;
+              }
+          },
+          mode);
+    scheduler->schedule(Scheduler::Event::PPU, when + duration);
+    updateSTAT();
 }
 
 void GPU::updateSTAT() {
@@ -198,36 +238,22 @@ GPU::Mode_VBlank::Mode_VBlank(GPU& gpu) {
     if (gpu.lcdEnabled()) {
         gpu.mem->interruptFlags.fireVBlank();
     }
-    gpu.screen.get().vblank();
-}
-void GPU::Mode_VBlank::step(GPU& gpu) {
-    // VBlank takes the same amount of time as 10 scanlines including HBlank
-    constexpr Ticks scanlineTime =
-          (Mode_ScanlineOAM::Time + Mode_ScanlineVRAM::Time +
-           Mode_HBlank::Time);
-    static_assert(scanlineTime == Mode_VBlank::Time / 10);
-    const auto lines = this->timer / scanlineTime;
-    while (stepTimer < lines) {
-        ++stepTimer;
-        ++gpu.currentLine;
-        GEM_ASSERT(gpu.currentLine <= 154);
-    }
+    gpu.endFrame();
 }
 GPU::Mode GPU::Mode_VBlank::nextMode(GPU& gpu) {
     GEM_ASSERT(gpu.currentLine == 154);
     gpu.currentLine = 0;
     gpu.currentWindowY = gpu.wy;
     gpu.windowLine = 0;
+    gpu.startFrame();
     return Mode_ScanlineOAM{};
 }
 
-void GPU::Mode_ScanlineOAM::step(GPU&) {}
 GPU::Mode GPU::Mode_ScanlineOAM::nextMode(const GPU&) {
     return Mode_ScanlineVRAM{};
 }
-void GPU::Mode_ScanlineVRAM::step(GPU&) {}
 GPU::Mode GPU::Mode_ScanlineVRAM::nextMode(GPU& gpu) {
-    gpu.renderScanLine();
+    gpu.logLine();
     return Mode_HBlank{};
 }
 
@@ -279,7 +305,9 @@ void GPU::dmaTransfer() {
     const u16 sourceAddr = u16(dma << 8u);
     const u8* sourcePtr = mem->ptr(sourceAddr);
     std::copy_n(sourcePtr, 0x9F, spriteData.block.data());
-    invalidateAllOAMCache();
+    for (u16 i = 0; i < 0x9F; ++i) {
+        logWrite(u16(SpriteData::Start + i), spriteData.block[i]);
+    }
 }
 
 namespace {
@@ -293,22 +321,6 @@ decltype(auto) index(A&& a, std::size_t idx) {
 #endif
 }
 
-template <typename T>
-decltype(auto) assert_unwrap(std::optional<T>& opt) {
-    GEM_ASSERT(opt.has_value());
-    return *opt;
-}
-template <typename T>
-decltype(auto) assert_unwrap(const std::optional<T>& opt) {
-    GEM_ASSERT(opt.has_value());
-    return *opt;
-}
-template <typename T>
-decltype(auto) assert_unwrap(std::optional<T>&& opt) {
-    GEM_ASSERT(opt.has_value());
-    return *opt;
-}
-
 #ifndef NDEBUG
 #define GEM_LOG_TILE_SET_MAP_CHANGES false
 #endif
@@ -447,42 +459,273 @@ constexpr Color spritePixelFromColorCode(const GPU::ColorCode c,
 
 }  // namespace
 
-void GPU::renderScanLine() {
+void GPU::startFrame() {
+    ++frameNumber;
+    drawing = std::exchange(frameRequested, false) ||
+              (drawInterval != 0 && frameNumber % drawInterval == 0);
+}
+
+GPU::LineRegisters GPU::lineRegisters() const {
+    return {lcdc,       scrollX, scrollY, wx,  currentWindowY,
+            windowLine, bgp,     obp0,    obp1};
+}
+
+bool GPU::LineRegisters::windowOnLine(const unsigned line) const {
+    return bitwise::test<5>(lcdc) && wx <= 166 && currentWindowY <= line &&
+           line < currentWindowY + Screen::Height;
+}
+
+void GPU::logLine() {
     if (!lcdEnabled())
         return;
 
-    std::array<u8, Screen::Width * Color::size()> line;
+    FrameLog& log = logs[current];
+    const LineRegisters registers = lineRegisters();
+    log.lines[currentLine] = registers;
+    log.writesBefore[currentLine] = u32(log.writes.size());
+    if (registers.windowOnLine(currentLine)) {
+        ++windowLine;
+    }
+}
+
+void GPU::endFrame() {
+    if (renderThread.joinable()) {
+        // the render thread has to be done with the last frame before it's
+        // shown, and before the log it finished is used again
+        waitForRenderer();
+        screen.get().vblank(lastDrawn ? &renderer.frame : nullptr);
+        submitRenderJob({current, drawing, false});
+    } else {
+        renderer.finish(logs[(current + 2) % logs.size()]);
+        if (drawing) {
+            renderer.draw(logs[current]);
+        }
+        screen.get().vblank(drawing ? &renderer.frame : nullptr);
+    }
+    lastDrawn = drawing;
+    current = (current + 1) % logs.size();
+    logs[current].lines = {};
+    logs[current].writes.clear();
+}
 
-    const TileMap tileMap = getTileMap(this->lcdc);
-    const TileSet tileSet = getTileSet(this->lcdc);
+const Frame& GPU::redrawFrame() {
+    waitForRenderer();
+    if (!lastDrawn) {
+        renderer.draw(logs[(current + 2) % logs.size()]);
+        lastDrawn = true;
+    }
+    return renderer.frame;
+}
+
+void GPU::setRenderThread(const bool enabled) {
+    if (enabled == renderThread.joinable()) {
+        return;
+    }
+    if (enabled) {
+        renderThread = std::thread{&GPU::runRenderJobs, this};
+        return;
+    }
+    waitForRenderer();
+    submitRenderJob({0, false, true});
+    renderThread.join();
+}
+
+void GPU::submitRenderJob(const RenderJob& job) {
+    waitUntil([&] { return renderJobs.push(job); });
+    if (!job.stop) {
+        ++renderJobsSubmitted;
+    }
+}
+
+void GPU::runRenderJobs() {
+    for (;;) {
+        std::optional<RenderJob> job;
+        waitUntil([&] { return (job = renderJobs.pop()).has_value(); });
+        if (job->stop) {
+            return;
+        }
+        renderer.finish(logs[(job->log + 2) % logs.size()]);
+        if (job->draw) {
+            renderer.draw(logs[job->log]);
+        }
+        renderJobsDone.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void GPU::Renderer::draw(const FrameLog& log) {
+    for (unsigned y = 0; y < Frame::Height; ++y) {
+        if (log.lines[y]) {
+            apply(log, log.writesBefore[y]);
+            currentLine = u8(y);
+            registers = *log.lines[y];
+            drawCurrentLine();
+        }
+    }
+}
+
+void GPU::Renderer::finish(const FrameLog& log) {
+    apply(log, log.writes.size());
+    applied = 0;
+}
+
+void GPU::Renderer::apply(const FrameLog& log, const usize end) {
+    for (; applied < end; ++applied) {
+        const FrameLog::Write write = log.writes[applied];
+        if (write.address >= SpriteData::Start) {
+            spriteData.block[write.address - SpriteData::Start] = write.value;
+            spritesStale = true;
+            continue;
+        }
+        const u16 address = u16(write.address - VideoRAMStart);
+        vram[address] = write.value;
+        if (address < TileSet0End - VideoRAMStart) {
+            atlas.invalidate(address);
+            layers.invalidateTile(address / Tile::MemSize);
+        } else {
+            layers.invalidateMapEntry(
+                  u16(address - (TileMap0Start - VideoRAMStart)));
+        }
+    }
+}
+
+void GPU::Renderer::drawCurrentLine() {
+    frame.setPalettes(currentLine,
+                      {registers.bgp, registers.obp0, registers.obp1});
+    drawLine(frame.line(currentLine));
+    if (verify) {
+        std::array<u8, Screen::Width * Color::size()> line;
+        std::array<u8, Screen::Width * Color::size()> reference;
+        frame.convertLine(currentLine, Frame::Format::RGBA8888, line.data());
+        drawLineReference(reference.data());
+        if (line != reference) {
+            ++mismatches;
+        }
+    }
+}
+
+template <bool SignedTiles,
+          usize BackgroundMap,
+          usize WindowMap,
+          bool Window,
+          bool Sprites>
+void GPU::Renderer::drawLineAs(u8* const line) {
+    atlas.refresh(vram.data());
+
+    // the background wraps around, so it may take two copies
+    const u8 scrollX = registers.scrollX;
+    const u8* const bg =
+          layers.row(vram.data(), atlas, BackgroundMap, SignedTiles,
+                     u8(registers.scrollY + currentLine));
+    const usize beforeWrap =
+          std::min(usize{Screen::Width}, LayerCache::Size - scrollX);
+    std::memcpy(line, bg + scrollX, beforeWrap);
+    std::memcpy(line + beforeWrap, bg, Screen::Width - beforeWrap);
+
+    if (Window && registers.windowOnLine(currentLine)) {
+        // where the window's first column lands, possibly off screen
+        const int left = registers.wx - 7;
+        const usize first = usize(std::max(0, left));
+        const u8* const window = layers.row(vram.data(), atlas, WindowMap,
+                                            SignedTiles, registers.windowLine);
+        std::memcpy(line + first, window + (int(first) - left),
+                    Screen::Width - first);
+    }
+
+    if constexpr (Sprites) {
+        // sprites behind the background only show over pixels the colour
+        // of background colour 0
+        std::array<bool, 16> showsBehind;
+        for (unsigned pixel = 0; pixel < showsBehind.size(); ++pixel) {
+            showsBehind[pixel] =
+                  frame.shade(currentLine, u8(pixel)) == (registers.bgp & 3u);
+        }
+        const LineSprites& onLine = spritesOnCurrentLine();
+        for (usize s = 0; s < onLine.count; ++s) {
+            const OAM& oam = sprites[onLine.indices[s]];
+            const int top = int(oam.screenPosYPlus16) - 16;
+            const int row = currentLine - top;
+            const unsigned y = unsigned(oam.yFlip ? 7 - row : row);
+            const pixels::Row& codes =
+                  oam.xFlip ? atlas.flippedRow(oam.tileNumber, y)
+                            : atlas.row(oam.tileNumber, y);
+            const u8 source = oam.palette == Palette::_0 ? Frame::Sprite0
+                                                         : Frame::Sprite1;
+
+            // colour 0 is transparent
+            const int leftEdge = int(oam.screenPosXPlus8) - 8;
+            const int from = std::max(leftEdge, 0);
+            const int to = std::min(leftEdge + Tile::Width, int(Screen::Width));
+            if (oam.priority == Priority::Front) {
+                for (int i = from; i < to; ++i) {
+                    const u8 code = codes[usize(i - leftEdge)];
+                    line[i] = code != 0 ? u8(source | code) : line[i];
+                }
+            } else {
+                for (int i = from; i < to; ++i) {
+                    const u8 code = codes[usize(i - leftEdge)];
+                    const bool shows = code != 0 && showsBehind[line[i]];
+                    line[i] = shows ? u8(source | code) : line[i];
+                }
+            }
+        }
+    }
+}
+
+template <usize... Index>
+constexpr std::array<GPU::Renderer::LineDrawer, sizeof...(Index)>
+GPU::Renderer::makeLineDrawers(std::index_sequence<Index...>) {
+    return {&Renderer::drawLineAs<(Index & 1u) != 0, (Index >> 1u) & 1u,
+                             (Index >> 2u) & 1u, ((Index >> 3u) & 1u) != 0,
+                             ((Index >> 4u) & 1u) != 0>...};
+}
+
+// indexed by lineDrawerIndex()
+const std::array<GPU::Renderer::LineDrawer, 32> GPU::Renderer::lineDrawers =
+      makeLineDrawers(std::make_index_sequence<32>{});
+
+namespace {
+// which of GPU::lineDrawers draws lines for `lcdc`
+constexpr usize lineDrawerIndex(const u8 lcdc) {
+    return (bitwise::test<4>(lcdc) ? 0u : 1u) |
+           (bitwise::test<3>(lcdc) ? 2u : 0u) |
+           (bitwise::test<6>(lcdc) ? 4u : 0u) |
+           (bitwise::test<5>(lcdc) ? 8u : 0u) |
+           (bitwise::test<1>(lcdc) ? 16u : 0u);
+}
+}  // namespace
+
+void GPU::Renderer::drawLine(u8* const line) {
+    (this->*lineDrawers[lineDrawerIndex(registers.lcdc)])(line);
+}
+
+void GPU::Renderer::drawLineReference(u8* const line) {
+    const u8 lcdc = registers.lcdc;
+    const u8 bgp = registers.bgp;
+    const TileMap tileMap = getTileMap(lcdc);
+    const TileSet tileSet = getTileSet(lcdc);
     const u16 mapStart = getMapStart(tileMap);
-    const u16 yOffset = (this->scrollY + this->currentLine) % 256;
+    const u16 yOffset = (registers.scrollY + this->currentLine) % 256;
 
     for (u16 i = 0; i < Screen::Width; ++i) {
-        const u16 xOffset = (i + this->scrollX) % 256;
+        const u16 xOffset = (i + registers.scrollX) % 256;
         const u16 idx = getTileMapIndex(xOffset, yOffset, mapStart);
         const u8 tileValue = index(vram, idx);
         const u16 tileAddress = getTileAddress(tileSet, tileValue);
 
-        std::optional<Tile>& tile =
-              index(cachedTiles, tileAddress / Tile::MemSize);
-        if (!tile) {
-            tile = loadCachedTile(tileAddress);
-        }
         const u16 pixelColumn = xOffset % GPU::Tile::Width;
         const u16 pixelRow = yOffset % GPU::Tile::Height;
 
         const ColorCode pixelCC =
-              tile->pixels[pixelColumn + pixelRow * GPU::Tile::Width];
+              tilePixel(vram, tileAddress, pixelColumn, pixelRow);
         const auto pixel = bgPixelFromColorCode(pixelCC, bgp);
 
         std::copy_n(pixel.begin(), pixel.size(),
-                    line.begin() + i * Color::size());
+                    line + i * Color::size());
     }
 
-    if (windowEnabled() && (currentWindowY <= currentLine &&
-                            currentLine < (currentWindowY + Screen::Height))) {
-        const auto absoluteWindowX = wx - 7;
+    if (registers.windowOnLine(currentLine)) {
+        const u8 windowLine = registers.windowLine;
+        const auto absoluteWindowX = registers.wx - 7;
         const auto windowMap = getWindowTileMap(lcdc);
         const auto windowMapStart = getWindowTileMapStart(windowMap);
         const u16 windowMapRow = windowLine / Tile::Height;
@@ -496,32 +739,24 @@ void GPU::renderScanLine() {
             const u8 tileValue = index(vram, windowTileIdx);
             const u16 tileAddress = getTileAddress(tileSet, tileValue);
 
-            std::optional<Tile>& tile =
-                  index(cachedTiles, tileAddress / Tile::MemSize);
-            if (!tile) {
-                tile = loadCachedTile(tileAddress);
-            }
-
             const auto pixelColumn = col % Tile::Width;
-            const ColorCode pixelCC = tile->pixels[static_cast<usize>(
-                  pixelColumn + windowTilePixelRow * Tile::Height)];
+            const ColorCode pixelCC =
+                  tilePixel(vram, tileAddress, unsigned(pixelColumn),
+                            windowTilePixelRow);
             const auto pixel = windowPixelFromColorCode(pixelCC, bgp);
 
             std::copy_n(pixel.begin(), pixel.size(),
-                        line.begin() + i * Color::size());
+                        line + i * Color::size());
         }
-        ++windowLine;
     }
 
-    if (spritesEnabled()) {
+    if (bitwise::test<1>(lcdc)) {
         const auto intersectors = findSpritesIntersectingCurrentLine();
         for (auto& idx : intersectors) {
-            OAM& oam = assert_unwrap(cachedSprites[idx]);
+            const OAM oam = loadOAMFromPtr(
+                  &spriteData.block[idx * SpriteData::OAMBlockSize]);
 
-            std::optional<Tile>& tile = index(cachedTiles, oam.tileNumber);
-            if (!tile) {
-                tile = loadCachedTile(oam.tileNumber * Tile::MemSize);
-            }
+            const u16 tileAddress = u16(oam.tileNumber * Tile::MemSize);
 
             const auto pixelRow = [&] {
                 const auto row = currentLine -
@@ -539,14 +774,16 @@ void GPU::renderScanLine() {
                     const auto col = i - leftEdge;
                     return oam.xFlip ? (Tile::Width - col - 1) : col;
                 }();
-                const ColorCode pixelCC = tile->pixels[static_cast<usize>(
-                      pixelColumn + pixelRow * Tile::Height)];
+                const ColorCode pixelCC =
+                      tilePixel(vram, tileAddress, unsigned(pixelColumn),
+                                unsigned(pixelRow));
                 const auto pixel = spritePixelFromColorCode(
-                      pixelCC, oam.palette == Palette::_0 ? obp0 : obp1);
+                      pixelCC, oam.palette == Palette::_0 ? registers.obp0
+                                                          : registers.obp1);
 
                 if (pixel != Colors::Transparent) {
                     u8* const dest =
-                          line.begin() + static_cast<usize>(i) * Color::size();
+                          line + static_cast<usize>(i) * Color::size();
                     if (oam.priority == Priority::Front ||
                         (bgPixelFromColorCode(ColorCode::C00, bgp) == dest)) {
                         std::copy_n(pixel.begin(), pixel.size(), dest);
@@ -555,8 +792,6 @@ void GPU::renderScanLine() {
             }
         }
     }
-
-    this->screen.get().renderLine(line, currentLine);
 }
 
 bool GPU::lcdEnabled() const {
@@ -571,14 +806,14 @@ bool GPU::windowEnabled() const {
     return bitwise::test<5>(lcdc) && (wx <= 166);
 }
 
-std::vector<usize> GPU::findSpritesIntersectingCurrentLine() {
+std::vector<usize> GPU::Renderer::findSpritesIntersectingCurrentLine() {
     std::vector<usize> intersectingIndices;
-    for (u16 i = 0; i < cachedSprites.size(); ++i) {
-        std::optional<OAM>& oam = cachedSprites[i];
-        if (!oam) {
-            oam = loadCachedOAM(i * SpriteData::OAMBlockSize);
-        }
-        const auto top = static_cast<int>(oam->screenPosYPlus16) - 16;
+    const auto oamAt = [&](const usize i) {
+        return loadOAMFromPtr(&spriteData.block[i * SpriteData::OAMBlockSize]);
+    };
+    for (u16 i = 0; i < SpriteData::TotalSprites; ++i) {
+        const OAM oam = oamAt(i);
+        const auto top = static_cast<int>(oam.screenPosYPlus16) - 16;
         if (top <= this->currentLine && this->currentLine < top + 8) {
             intersectingIndices.push_back(i);
             if (intersectingIndices.size() >= 10) {
@@ -588,8 +823,7 @@ std::vector<usize> GPU::findSpritesIntersectingCurrentLine() {
     }
     std::sort(intersectingIndices.begin(), intersectingIndices.end(),
               [&](const usize a, const usize b) {
-                  return assert_unwrap(cachedSprites[a]).screenPosXPlus8 <
-                         assert_unwrap(cachedSprites[b]).screenPosXPlus8;
+                  return oamAt(a).screenPosXPlus8 < oamAt(b).screenPosXPlus8;
               });
     return intersectingIndices;
 }
@@ -629,10 +863,6 @@ void GPU::dumpTileMemory() {
 
     for (u16 tileNumber = 0; tileNumber < totalTiles; ++tileNumber) {
         const u16 tileAddress = tileNumber * Tile::MemSize;
-        std::optional<Tile>& tile = index(cachedTiles, tileNumber);
-        if (!tile) {
-            tile = loadCachedTile(tileAddress);
-        }
 
         for (unsigned r = 0; r < Tile::Height; ++r) {
             for (unsigned c = 0; c < Tile::Width; ++c) {
@@ -643,8 +873,7 @@ void GPU::dumpTileMemory() {
                 const std::size_t index =
                       (column + row * imageWidth) * bytesPerPixel;
 
-                const ColorCode pixelCC =
-                      tile->pixels[c + r * GPU::Tile::Width];
+                const ColorCode pixelCC = tilePixel(vram, tileAddress, c, r);
                 const auto pixel = bgPixelFromColorCode(pixelCC, bgp);
 
                 std::copy_n(pixel.begin(), bytesPerPixel, data.data() + index);
@@ -676,16 +905,11 @@ void GPU::dumpBackgroundMap(TileMap map) {
             const u8 tileValue = index(vram, idx);
             const u16 tileAddress = getTileAddress(tileSet, tileValue);
 
-            std::optional<Tile>& tile =
-                  index(cachedTiles, tileAddress / Tile::MemSize);
-            if (!tile) {
-                tile = loadCachedTile(tileAddress);
-            }
             const u16 pixelColumn = c % GPU::Tile::Width;
             const u16 pixelRow = r % GPU::Tile::Height;
 
             const ColorCode pixelCC =
-                  tile->pixels[pixelColumn + pixelRow * GPU::Tile::Width];
+                  tilePixel(vram, tileAddress, pixelColumn, pixelRow);
             const auto pixel = bgPixelFromColorCode(pixelCC, bgp);
 
             const auto index = (c + r * imageWidth) * bytesPerPixel;
@@ -1,16 +1,24 @@
 #ifndef GEM_GPU_HPP
 #define GEM_GPU_HPP
 
+#include "frame.hpp"
 #include "fwd.hpp"
+#include "layer_cache.hpp"
 #include "mem.hpp"
+#include "spsc_ring.hpp"
+#include "tile_atlas.hpp"
 
 #include <array>
+#include <atomic>
 #include <optional>
+#include <thread>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace gem {
 
+struct Scheduler;
 struct Screen;
 
 struct GPU {
@@ -112,22 +120,20 @@ struct GPU {
         C11 = 0b11,
     };
     struct Tile {
-        explicit Tile(const u8* const data);
         static constexpr u8 Width = 8, Height = 8;
         static constexpr u8 MemSize = 2 * Height;
-        std::array<ColorCode, Width * Height> pixels;
     };
 
     explicit GPU(Screen& screen);
+    ~GPU();
 
     void setMem(Mem* const mem) { this->mem = mem; }
+    void setScheduler(Scheduler* scheduler);
 
     const u8* vramPtr(const u16 address) const { return vram.data() + address; }
-    u8* writableVramPtr(const u16 address) {
-        if (address < TileSet0End - VideoRAMStart) {
-            invalidateTileCacheForAddress(address);
-        }
-        return vram.data() + address;
+    void writeVRAM(const u16 address, const u8 value) {
+        vram[address] = value;
+        logWrite(u16(VideoRAMStart + address), value);
     }
     const u8* registerPtr(const u16 address) const {
         return const_cast<GPU*>(this)->registerPtr(address);
@@ -136,13 +142,19 @@ struct GPU {
     const u8* spriteDataPtr(const u16 address) const {
         return spriteData.block.data() + address;
     }
-    u8* writableSpriteDataPtr(const u16 address) {
-        invalidateOAMCacheForAddress(address);
-        return vram.data() + address;
+    void writeSpriteData(const u16 address, const u8 value) {
+        spriteData.block[address] = value;
+        logWrite(u16(SpriteData::Start + address), value);
     }
     bool consumeWrite(const u16 address, const u8 value);
+    // whether consumeWrite() takes writes to `address`
+    static constexpr bool handlesWrite(const u16 address) {
+        return address == Registers::DMA;
+    }
 
-    void step(DeltaTicks deltaTicks);
+    // moves on to the next mode or VBlank line. `when` is the time the event
+    // was scheduled for.
+    void handleEvent(Ticks when);
 
     void updateSTAT();
 
@@ -152,11 +164,42 @@ struct GPU {
     bool spritesEnabled() const;
     bool windowEnabled() const;
 
-    std::vector<usize> findSpritesIntersectingCurrentLine();
+    // which frames are drawn: every `interval`th one, plus any asked for
+    // with requestFrame(). with an interval of 0 only requested frames are.
+    // skipped frames keep exact timing, LY, STAT and interrupts included;
+    // only drawing and presenting them is left out. takes effect from the
+    // next frame.
+    void setFrameSkip(const unsigned interval) { drawInterval = interval; }
+    // draws the next frame whatever the frame skip
+    void requestFrame() { frameRequested = true; }
+    bool drawingFrame() const { return drawing; }
+    // the last frame that was finished, drawn now from its log if it was
+    // skipped. exact until the next one is finished.
+    const Frame& redrawFrame();
+
+    // draws frames on a thread of their own, a frame behind: each frame's
+    // log is handed over when it's finished and the frame is shown at the
+    // next VBlank, while the one after it runs. the frames themselves are
+    // the same as drawn inline, which is what happens with it off (the
+    // default).
+    void setRenderThread(bool enabled);
+
+    // draws every line with the reference renderer as well, and counts the
+    // lines where the two differ. for gem_headless --verify-renderer and the
+    // renderer tests.
+    void setVerifyRendering(const bool verify) {
+        waitForRenderer();
+        renderer.verify = verify;
+    }
+    unsigned long long mismatchedLines() {
+        waitForRenderer();
+        return renderer.mismatches;
+    }
 
    private:
     std::reference_wrapper<Screen> screen;
     Mem* mem = nullptr;
+    Scheduler* scheduler = nullptr;
 
     Mem::Block vram;
     SpriteData spriteData;
@@ -164,7 +207,6 @@ struct GPU {
     struct Mode;
     struct Mode_Base {
         Mode_Base() {}
-        Ticks timer = 0;
     };
     struct Mode_ScanlineOAM final : Mode_Base {
         enum : u8 {
@@ -173,7 +215,6 @@ struct GPU {
         enum : Ticks {
             Time = 80,
         };
-        static void step(GPU& gpu);
         static Mode nextMode(const GPU& gpu);
     };
     struct Mode_ScanlineVRAM final : Mode_Base {
@@ -183,7 +224,6 @@ struct GPU {
         enum : Ticks {
             Time = 172,
         };
-        static void step(GPU& gpu);
         static Mode nextMode(GPU& gpu);
     };
     struct Mode_HBlank final : Mode_Base {
@@ -193,9 +233,11 @@ struct GPU {
         enum : Ticks {
             Time = 204,
         };
-        static void step(const GPU&) {}
         static Mode nextMode(GPU& gpu);
     };
+    static constexpr Ticks ScanlineTime = Mode_ScanlineOAM::Time +
+                                          Mode_ScanlineVRAM::Time +
+                                          Mode_HBlank::Time;
     struct Mode_VBlank final : Mode_Base {
         enum : u8 {
             Number = 0b01,
@@ -203,13 +245,11 @@ struct GPU {
         enum : Ticks {
             Time = 4560,
         };
-        void step(GPU&);
         static Mode nextMode(GPU& gpu);
 
         explicit Mode_VBlank(GPU& gpu);
 
-       private:
-        u8 stepTimer = 0;
+        u8 linesElapsed = 0;
     };
 
     struct Mode
@@ -240,17 +280,150 @@ struct GPU {
     u8 currentWindowY = 0;
     u8 windowLine = 0;
 
-    using CachedTile = Tile;
-    CachedTile loadCachedTile(u16 address) const;
-    void invalidateTileCacheForAddress(u16 address);
-    std::vector<std::optional<CachedTile>> cachedTiles;
-
-    OAM loadCachedOAM(u16 address) const;
-    void invalidateOAMCacheForAddress(u16 address);
-    void invalidateAllOAMCache();
-    std::vector<std::optional<OAM>> cachedSprites;
+    unsigned drawInterval = 1;
+    bool frameRequested = false;
+    bool drawing = true;
+    unsigned long long frameNumber = 0;
+    // decides whether the frame that's starting is drawn
+    void startFrame();
+
+    // what drawing a line depends on besides VRAM and OAM
+    struct LineRegisters {
+        u8 lcdc;
+        u8 scrollX;
+        u8 scrollY;
+        u8 wx;
+        u8 currentWindowY;
+        u8 windowLine;
+        u8 bgp;
+        u8 obp0;
+        u8 obp1;
+
+        bool windowOnLine(unsigned line) const;
+    };
+    LineRegisters lineRegisters() const;
+
+    // everything drawing a frame depends on, in the order it happened: the
+    // registers each line was reached with and every write to VRAM and OAM.
+    // a frame's log starts at the VBlank before it, so whatever a game sets
+    // up then comes ahead of the first line.
+    struct FrameLog {
+        // a write to VRAM or OAM, by its address on the bus
+        struct Write {
+            u16 address;
+            u8 value;
+        };
+        // for each line reached with the LCD on, its registers and how many
+        // of `writes` came before it
+        std::array<std::optional<LineRegisters>, Frame::Height> lines = {};
+        std::array<u32, Frame::Height> writesBefore = {};
+        std::vector<Write> writes = {};
+    };
+    void logWrite(const u16 address, const u8 value) {
+        logs[current].writes.push_back({address, value});
+    }
+    // notes the registers the current line is drawn with
+    void logLine();
+    // draws the frame that just finished, unless it's skipped, shows it
+    // and starts the log of the next
+    void endFrame();
+    // the frame being logged, the one before it (drawn already, or not until
+    // redrawFrame() asks) and the one before that, which the render thread
+    // may still be finishing
+    std::array<FrameLog, 3> logs = {};
+    usize current = 0;
+    bool lastDrawn = false;
+
+    // draws frames from their logs, in one go once each is finished. it has
+    // VRAM and OAM of its own, brought up to date from the log as it goes, so
+    // each line sees them as the GPU did when it reached that line.
+    struct Renderer {
+        // draws every line of `log` after the writes that came before it.
+        // `log` follows the last one given to finish().
+        void draw(const FrameLog& log);
+        // applies the writes left in `log`, all of them if it wasn't drawn
+        void finish(const FrameLog& log);
+
+        Frame frame = {};
+        bool verify = false;
+        unsigned long long mismatches = 0;
 
-    void renderScanLine();
+       private:
+        // applies `log`'s writes up to `end`
+        void apply(const FrameLog& log, usize end);
+        usize applied = 0;
+
+        Mem::Block vram = Mem::makeBlock<0x8000, 0x9FFF>();
+        SpriteData spriteData = {};
+        TileAtlas atlas = {};
+        LayerCache layers = {};
+
+        // OAM decoded, and the sprites on each line: the first 10 in OAM
+        // order that cover it, sorted by X, which is the order they're drawn
+        // in. both are rebuilt the next time they're used after OAM changes.
+        struct LineSprites {
+            static constexpr usize Max = 10;
+            std::array<u8, Max> indices = {};
+            u8 count = 0;
+        };
+        void bucketSprites();
+        const LineSprites& spritesOnCurrentLine();
+        std::array<OAM, SpriteData::TotalSprites> sprites = {};
+        std::array<LineSprites, Frame::Height> lineSprites = {};
+        bool spritesStale = true;
+        // the original search, for the reference renderer
+        std::vector<usize> findSpritesIntersectingCurrentLine();
+
+        // the line being drawn and its registers
+        u8 currentLine = 0;
+        LineRegisters registers = {};
+
+        // draws the current line into `frame`
+        void drawCurrentLine();
+        // drawLine draws the current line, a byte per pixel, from the cached
+        // layers; the reference renderer is the original one, pixel by pixel
+        // and straight to RGBA, kept to check it against.
+        void drawLine(u8* line);
+        void drawLineReference(u8* line);
+
+        // drawLine with every LCDC bit that matters to drawing known up
+        // front: whether tile numbers are signed, the background and window
+        // maps and whether the window and sprites are on. drawLine picks one
+        // from `lineDrawers` by the line's LCDC.
+        template <bool SignedTiles,
+                  usize BackgroundMap,
+                  usize WindowMap,
+                  bool Window,
+                  bool Sprites>
+        void drawLineAs(u8* line);
+        using LineDrawer = void (Renderer::*)(u8* line);
+        template <usize... Index>
+        static constexpr std::array<LineDrawer, sizeof...(Index)>
+        makeLineDrawers(std::index_sequence<Index...>);
+        static const std::array<LineDrawer, 32> lineDrawers;
+    };
+    Renderer renderer = {};
+
+    // what the render thread does with each finished frame: finishes the
+    // one before it and draws it, if `draw`
+    struct RenderJob {
+        usize log;
+        bool draw;
+        bool stop;
+    };
+    void submitRenderJob(const RenderJob& job);
+    void runRenderJobs();
+    // returns once the render thread has done every job it's been given
+    void waitForRenderer() {
+        waitUntil([&] {
+            return renderJobsDone.load(std::memory_order_acquire) ==
+                   renderJobsSubmitted;
+        });
+    }
+    SPSCRing<RenderJob, 4> renderJobs = {};
+    unsigned long long renderJobsSubmitted = 0;
+    std::atomic<unsigned long long> renderJobsDone{0};
+    std::thread renderThread = {};
 
     void dumpTileMemory();
     void dumpBackgroundMap(TileMap map);
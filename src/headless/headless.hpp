@@ -0,0 +1,59 @@
+#ifndef GEM_HEADLESS_HPP
+#define GEM_HEADLESS_HPP
+
+#include "frame.hpp"
+#include "fs.hpp"
+#include "fwd.hpp"
+#include "input.hpp"
+#include "screen.hpp"
+
+#include <optional>
+#include <vector>
+
+// the headless backend: an offscreen Screen, a Window that never opens
+// anything, and an Input whose button states come from a script instead of
+// the keyboard.
+
+namespace gem {
+
+struct Screen::Impl {
+    // the last frame, converted to `format`
+    std::array<u8, Screen::Width * Screen::Height * 4> frame = {};
+    Frame::Format format = Frame::Format::RGBA8888;
+};
+
+struct Window::Impl {
+    bool open = true;
+    unsigned long long frames = 0;
+};
+
+namespace headless {
+
+void setButtonPressed(Input::Button button, bool pressed);
+
+// one event per line: `<frame> <button> <down|up>`, where button is one of
+// Up, Down, Left, Right, Start, Select, A, B. lines starting with '#' are
+// ignored. events may be in any order of frames; those on the same frame are
+// applied in the order they're written.
+struct InputScript {
+    struct Event {
+        unsigned long long frame;
+        Input::Button button;
+        bool pressed;
+    };
+
+    static std::optional<InputScript> load(const fs::AbsolutePath& path);
+
+    // applies every event scheduled at or before `frame`
+    void apply(unsigned long long frame);
+
+    std::vector<Event> events = {};
+    usize next = 0;
+};
+
+void writePPM(const Screen& screen, const fs::AbsolutePath& path);
+
+}  // namespace headless
+}  // namespace gem
+
+#endif
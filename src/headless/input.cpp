@@ -0,0 +1,79 @@
+#include "headless.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace gem {
+namespace {
+std::array<bool, 8> pressedButtons = {};
+
+std::optional<Input::Button> parseButton(const std::string& name) {
+    using B = Input::Button;
+    static constexpr std::pair<const char*, B> names[] = {
+          {"Up", B::Up},       {"Down", B::Down},     {"Left", B::Left},
+          {"Right", B::Right}, {"Start", B::Start},   {"Select", B::Select},
+          {"A", B::A},         {"B", B::B},
+    };
+    for (auto& [n, b] : names) {
+        if (name == n) {
+            return b;
+        }
+    }
+    return std::nullopt;
+}
+}  // namespace
+
+bool Input::isButtonPressed(const Input::Button b) {
+    return pressedButtons[idx(b)];
+}
+
+void headless::setButtonPressed(const Input::Button b, const bool pressed) {
+    pressedButtons[idx(b)] = pressed;
+}
+
+std::optional<headless::InputScript> headless::InputScript::load(
+      const fs::AbsolutePath& path) {
+    std::ifstream in{path.path};
+    if (!in.is_open()) {
+        return std::nullopt;
+    }
+    InputScript script;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream words{line};
+        unsigned long long frame;
+        std::string buttonName, state;
+        if (!(words >> frame >> buttonName >> state)) {
+            GEM_LOG("malformed input script line: '" << line << "'");
+            return std::nullopt;
+        }
+        const auto button = parseButton(buttonName);
+        if (!button || (state != "down" && state != "up")) {
+            GEM_LOG("malformed input script line: '" << line << "'");
+            return std::nullopt;
+        }
+        script.events.push_back({frame, *button, state == "down"});
+    }
+    // apply() walks the events in order; events on the same frame keep the
+    // order they were written in
+    std::stable_sort(script.events.begin(), script.events.end(),
+                     [](const Event& a, const Event& b) {
+                         return a.frame < b.frame;
+                     });
+    return script;
+}
+
+void headless::InputScript::apply(const unsigned long long frame) {
+    while (next < events.size() && events[next].frame <= frame) {
+        setButtonPressed(events[next].button, events[next].pressed);
+        ++next;
+    }
+}
+
+}  // namespace gem
@@ -0,0 +1,473 @@
+#include "fs.hpp"
+#include "gameboy.hpp"
+#include "headless.hpp"
+#include "idle_loops.hpp"
+#include "pacer.hpp"
+#include "pixels.hpp"
+#include "profiler.hpp"
+#include "rom.hpp"
+#include "screen.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+#if GEM_JIT
+constexpr const char* cpuModes = "'interpreter', 'blocks' (default) or 'jit'";
+#else
+constexpr const char* cpuModes = "'interpreter' or 'blocks' (default)";
+#endif
+#if GEM_PROFILE
+constexpr const char* profileUsage =
+      "\n    --profile FILE    write collapsed call stacks for a flamegraph "
+      "and\n                      print the hottest opcodes and PCs";
+#else
+constexpr const char* profileUsage = "";
+#endif
+
+void usage(const char* argv0) {
+    GEM_LOG("usage: " << argv0 << " ROM [options]\n"
+                      << "    --frames N        stop after N frames\n"
+                      << "    --cycles N        stop after N clock ticks\n"
+                      << "    --input FILE      play back an input script\n"
+                      << "    --dump-frame FILE write the last frame as a PPM\n"
+                      << "    --draw-every N    only draw every Nth frame, or none if 0\n"
+                      << "    --pixel-format F  convert frames to 'rgba8888' (default),\n"
+                      << "                      'rgb565' or 'grey8'\n"
+                      << "    --render-thread   draw frames on a thread of their own\n"
+                      << "    --speed N         run at N times real time (default: 0,\n"
+                      << "                      as fast as possible)\n"
+                      << "    --cpu MODE        " << cpuModes << "\n"
+                      << "    --idle-loops FILE read idle loop overrides\n"
+                      << "    --cross-check     run the interpreter in lockstep and stop\n"
+                      << "                      at the first instruction that differs\n"
+                      << "    --simd LEVEL      convert pixels with 'scalar', 'sse2', 'ssse3'\n"
+                      << "                      or 'avx2' (default: the best supported)\n"
+                      << "    --verify-renderer check every line against the reference\n"
+                      << "                      renderer\n"
+                      << "    --opcode-stats FILE\n"
+                      << "                      count runs of opcodes, for gen_opcodes.py --fuse"
+                      << profileUsage);
+}
+
+// `text` if it's all decimal digits and fits, otherwise nothing: strtoull
+// alone reads 'abc' as 0 and '-1' as the largest number there is
+std::optional<unsigned long long> parseCount(const char* text) {
+    if (!std::isdigit(static_cast<unsigned char>(*text))) {
+        return std::nullopt;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long long count = std::strtoull(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE) {
+        return std::nullopt;
+    }
+    return count;
+}
+
+struct Options {
+    const char* romPath = nullptr;
+    unsigned long long frames = 0;
+    gem::Ticks cycles = 0;
+    const char* inputPath = nullptr;
+    const char* dumpFramePath = nullptr;
+    unsigned drawEvery = 1;
+    gem::Frame::Format pixelFormat = gem::Frame::Format::RGBA8888;
+    bool renderThread = false;
+    double speed = gem::Pacer::Unlimited;
+    gem::GameBoy::CPUMode cpuMode = gem::GameBoy::CPUMode::Blocks;
+    const char* cpuModeName = "blocks";
+    const char* idleLoopsPath = nullptr;
+    bool crossCheck = false;
+    std::optional<gem::pixels::SIMD> simd = {};
+    bool verifyRenderer = false;
+    const char* opcodeStatsPath = nullptr;
+    const char* profilePath = nullptr;
+};
+
+std::optional<Options> parseOptions(int argc, const char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const auto isFlag = [&](const char* flag) {
+            return std::strcmp(argv[i], flag) == 0 && i + 1 < argc;
+        };
+        if (isFlag("--frames")) {
+            const auto frames = parseCount(argv[++i]);
+            if (!frames) {
+                return std::nullopt;
+            }
+            options.frames = *frames;
+        } else if (isFlag("--cycles")) {
+            const auto cycles = parseCount(argv[++i]);
+            if (!cycles) {
+                return std::nullopt;
+            }
+            options.cycles = *cycles;
+        } else if (isFlag("--input")) {
+            options.inputPath = argv[++i];
+        } else if (isFlag("--dump-frame")) {
+            options.dumpFramePath = argv[++i];
+        } else if (isFlag("--draw-every")) {
+            const auto drawEvery = parseCount(argv[++i]);
+            if (!drawEvery ||
+                *drawEvery > std::numeric_limits<unsigned>::max()) {
+                return std::nullopt;
+            }
+            options.drawEvery = unsigned(*drawEvery);
+        } else if (isFlag("--pixel-format")) {
+            using Format = gem::Frame::Format;
+            ++i;
+            bool known = false;
+            for (const Format format :
+                 {Format::RGBA8888, Format::RGB565, Format::Grey8}) {
+                if (std::strcmp(argv[i], gem::Frame::name(format)) == 0) {
+                    options.pixelFormat = format;
+                    known = true;
+                }
+            }
+            if (!known) {
+                return std::nullopt;
+            }
+        } else if (std::strcmp(argv[i], "--render-thread") == 0) {
+            options.renderThread = true;
+        } else if (isFlag("--speed")) {
+            char* end = nullptr;
+            options.speed = std::strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' ||
+                !std::isfinite(options.speed) || options.speed < 0.0) {
+                return std::nullopt;
+            }
+        } else if (isFlag("--cpu")) {
+            using CPUMode = gem::GameBoy::CPUMode;
+            options.cpuModeName = argv[++i];
+            if (std::strcmp(argv[i], "interpreter") == 0) {
+                options.cpuMode = CPUMode::Interpreter;
+            } else if (std::strcmp(argv[i], "blocks") == 0) {
+                options.cpuMode = CPUMode::Blocks;
+#if GEM_JIT
+            } else if (std::strcmp(argv[i], "jit") == 0) {
+                options.cpuMode = CPUMode::JIT;
+#endif
+            } else {
+                return std::nullopt;
+            }
+        } else if (isFlag("--idle-loops")) {
+            options.idleLoopsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--cross-check") == 0) {
+            options.crossCheck = true;
+        } else if (isFlag("--simd")) {
+            using gem::pixels::SIMD;
+            ++i;
+            for (const SIMD simd :
+                 {SIMD::Scalar, SIMD::SSE2, SIMD::SSSE3, SIMD::AVX2}) {
+                if (std::strcmp(argv[i], gem::pixels::name(simd)) == 0) {
+                    options.simd = simd;
+                }
+            }
+            if (!options.simd || !gem::pixels::supported(*options.simd)) {
+                return std::nullopt;
+            }
+        } else if (std::strcmp(argv[i], "--verify-renderer") == 0) {
+            options.verifyRenderer = true;
+        } else if (isFlag("--opcode-stats")) {
+            options.opcodeStatsPath = argv[++i];
+#if GEM_PROFILE
+        } else if (isFlag("--profile")) {
+            options.profilePath = argv[++i];
+#endif
+        } else if (argv[i][0] != '-' && options.romPath == nullptr) {
+            options.romPath = argv[i];
+        } else {
+            return std::nullopt;
+        }
+    }
+    // they all need the instruction hook
+    const int hooks = options.crossCheck +
+                      (options.opcodeStatsPath != nullptr) +
+                      (options.profilePath != nullptr);
+    if (options.romPath == nullptr || hooks > 1) {
+        return std::nullopt;
+    }
+    if (options.frames == 0 && options.cycles == 0) {
+        options.frames = 60 * 60;
+    }
+    return options;
+}
+
+gem::fs::AbsolutePath absolute(const char* path) {
+    return gem::fs::AbsolutePath{gem::fs::RelativePathView{path}};
+}
+
+// the CPU state after every instruction, for --cross-check
+struct Trace {
+    struct State {
+        gem::Ticks ticks;
+        gem::u16 af, bc, de, hl, sp, pc;
+
+        bool operator==(const State& o) const {
+            return ticks == o.ticks && af == o.af && bc == o.bc &&
+                   de == o.de && hl == o.hl && sp == o.sp && pc == o.pc;
+        }
+        bool operator!=(const State& o) const { return !(*this == o); }
+    };
+
+    static void record(void* const context, const gem::CPU& cpu) {
+        const auto& reg = cpu.reg;
+        static_cast<Trace*>(context)->states.push_back(
+              State{cpu.getTicks(), reg.getAF(), reg.getBC(), reg.getDE(),
+                    reg.getHL(), reg.getSP(), reg.getPC()});
+    }
+
+    std::vector<State> states = {};
+    unsigned long long instructions = 0;
+};
+
+void printState(const char* name, const Trace::State* state) {
+    using gem::hexString;
+    std::cerr << name << ": ";
+    if (state == nullptr) {
+        std::cerr << "(no instruction)\n";
+        return;
+    }
+    std::cerr << "ticks " << state->ticks << " AF " << hexString(state->af)
+              << " BC " << hexString(state->bc) << " DE "
+              << hexString(state->de) << " HL " << hexString(state->hl)
+              << " SP " << hexString(state->sp) << " PC "
+              << hexString(state->pc) << '\n';
+}
+
+// compares the instructions both machines ran since the last call
+bool compareTraces(Trace& trace, Trace& reference, const char* mode) {
+    const auto& a = trace.states;
+    const auto& b = reference.states;
+    for (gem::usize i = 0; i < std::max(a.size(), b.size()); ++i) {
+        const auto* const sa = i < a.size() ? &a[i] : nullptr;
+        const auto* const sb = i < b.size() ? &b[i] : nullptr;
+        if (sa == nullptr || sb == nullptr || *sa != *sb) {
+            std::cerr << "CPU modes diverged after instruction "
+                      << trace.instructions + i << '\n';
+            printState(mode, sa);
+            printState("interpreter", sb);
+            return false;
+        }
+    }
+    trace.instructions += a.size();
+    trace.states.clear();
+    reference.states.clear();
+    return true;
+}
+// how often each pair and triple of opcodes ran back to back, for
+// --opcode-stats
+struct OpcodeStats {
+    using Run = unsigned long long;
+
+    static void record(void* const context, const gem::CPU& cpu) {
+        auto& stats = *static_cast<OpcodeStats*>(context);
+        // PC is already at the next instruction
+        const gem::u16 pc = cpu.reg.getPC();
+        Run code = cpu.bus.read(pc);
+        if (code == 0xCB) {
+            code = (code << 8u) | cpu.bus.read(gem::u16(pc + 1));
+        }
+        stats.recent = ((stats.recent << 16u) | code) & 0xFFFF'FFFF'FFFF;
+        ++stats.seen;
+        if (stats.seen >= 2) {
+            ++stats.runs[stats.recent & 0xFFFF'FFFF];
+        }
+        if (stats.seen >= 3) {
+            ++stats.runs[stats.recent | TripleBit];
+        }
+    }
+
+    // one line per run, most frequent first
+    std::string format(const char* romPath) const {
+        std::vector<std::pair<Run, unsigned long long>> sorted(runs.begin(),
+                                                               runs.end());
+        std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) {
+            return a.second != b.second ? a.second > b.second
+                                        : a.first < b.first;
+        });
+        sorted.resize(std::min(sorted.size(), MaxLines));
+        std::ostringstream out;
+        out << "# opcode runs in " << romPath << ", most frequent first\n";
+        for (const auto& [run, count] : sorted) {
+            out << count;
+            for (int shift = (run & TripleBit) ? 32 : 16; shift >= 0;
+                 shift -= 16) {
+                const auto code = gem::u16(run >> unsigned(shift));
+                out << " 0x";
+                if (code > 0xFF) {
+                    out << gem::hexString(code);
+                } else {
+                    out << gem::hexString(gem::u8(code));
+                }
+            }
+            out << '\n';
+        }
+        return out.str();
+    }
+
+    static constexpr Run TripleBit = Run{1} << 48u;
+    static constexpr gem::usize MaxLines = 256;
+    // the last three opcodes, 16 bits each
+    Run recent = 0;
+    unsigned long long seen = 0;
+    std::unordered_map<Run, unsigned long long> runs = {};
+};
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    std::ios::sync_with_stdio(false);
+
+    const auto options = parseOptions(argc, argv);
+    if (!options) {
+        usage(argv[0]);
+        std::exit(1);
+    }
+
+    auto rom = gem::ROM::load(absolute(options->romPath));
+    if (!rom) {
+        std::cerr << "couldn't load ROM file at '" << options->romPath
+                  << "'\n";
+        std::exit(1);
+    }
+
+    gem::headless::InputScript inputScript;
+    if (options->inputPath) {
+        auto loaded = gem::headless::InputScript::load(
+              absolute(options->inputPath));
+        if (!loaded) {
+            std::cerr << "couldn't load input script at '"
+                      << options->inputPath << "'\n";
+            std::exit(1);
+        }
+        inputScript = *std::move(loaded);
+    }
+
+    std::optional<gem::IdleLoopOverrides> idleLoopOverrides;
+    if (options->idleLoopsPath) {
+        idleLoopOverrides = gem::IdleLoopOverrides::load(
+              absolute(options->idleLoopsPath), gem::ROM::title(*rom));
+        if (!idleLoopOverrides) {
+            std::cerr << "couldn't load idle loop overrides at '"
+                      << options->idleLoopsPath << "'\n";
+            std::exit(1);
+        }
+    }
+
+    const auto frameLimit = options->frames != 0
+                                  ? options->frames
+                                  : std::numeric_limits<unsigned long long>::max();
+    const auto tickLimit = options->cycles != 0
+                                 ? options->cycles
+                                 : std::numeric_limits<gem::Ticks>::max();
+
+    // the reference machine for --cross-check
+    std::optional<gem::Window> refWindow;
+    std::optional<gem::Screen> refScreen;
+    std::optional<gem::GameBoy> refGameBoy;
+    Trace trace;
+    Trace refTrace;
+    if (options->crossCheck) {
+        refWindow.emplace();
+        refScreen.emplace(*refWindow);
+        refGameBoy.emplace(*rom, *refScreen);
+        refGameBoy->cpu.setInstructionHook(&Trace::record, &refTrace);
+    }
+
+    gem::Window window;
+    gem::Screen screen{window};
+    screen.getImpl().format = options->pixelFormat;
+    gem::GameBoy gameBoy{*std::move(rom), screen};
+    gameBoy.setCPUMode(options->cpuMode);
+    if (idleLoopOverrides) {
+        gameBoy.blockCache.setIdleLoopOverrides(*std::move(idleLoopOverrides));
+    }
+    if (options->crossCheck) {
+        gameBoy.cpu.setInstructionHook(&Trace::record, &trace);
+    }
+    if (options->simd) {
+        gem::pixels::use(*options->simd);
+    }
+    gameBoy.gpu.setVerifyRendering(options->verifyRenderer);
+    gameBoy.gpu.setFrameSkip(options->drawEvery);
+    gameBoy.gpu.setRenderThread(options->renderThread);
+    OpcodeStats opcodeStats;
+    if (options->opcodeStatsPath) {
+        gameBoy.cpu.setInstructionHook(&OpcodeStats::record, &opcodeStats);
+    }
+#if GEM_PROFILE
+    gem::Profiler profiler{gameBoy.cpu};
+    if (options->profilePath) {
+        gameBoy.cpu.setProfiler(&profiler);
+    }
+#endif
+
+    const auto& frames = window.getImpl().frames;
+    gem::Pacer pacer{options->speed};
+    const auto start = std::chrono::steady_clock::now();
+    inputScript.apply(0);
+    while (frames < frameLimit && gameBoy.getTicks() < tickLimit) {
+        const auto framesBefore = frames;
+        gameBoy.step();
+        pacer.pace(gameBoy.getTicks());
+        if (refGameBoy) {
+            refGameBoy->step();
+            if (!compareTraces(trace, refTrace, options->cpuModeName)) {
+                std::exit(1);
+            }
+        }
+        if (frames != framesBefore) {
+            inputScript.apply(frames);
+        }
+    }
+    const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+    const double emulatedSeconds =
+          double(gameBoy.getTicks()) / double(gem::Pacer::TicksPerSecond);
+    std::cout << "frames: " << frames << "\nticks: " << gameBoy.getTicks()
+              << "\nhost seconds: " << elapsed.count()
+              << "\nspeed: " << emulatedSeconds / elapsed.count() << "x\n";
+
+    if (options->verifyRenderer) {
+        const auto mismatches = gameBoy.gpu.mismatchedLines();
+        std::cout << "lines that differ from the reference renderer ("
+                  << gem::pixels::name(gem::pixels::current())
+                  << "): " << mismatches << '\n';
+        if (mismatches != 0) {
+            std::exit(1);
+        }
+    }
+
+    if (options->dumpFramePath) {
+        // the last frame may have been skipped, or not shown yet by the
+        // render thread
+        auto& impl = screen.getImpl();
+        gameBoy.gpu.redrawFrame().convert(impl.format, impl.frame.data());
+        gem::headless::writePPM(screen, absolute(options->dumpFramePath));
+    }
+    if (options->opcodeStatsPath) {
+        gem::fs::write(opcodeStats.format(options->romPath),
+                       absolute(options->opcodeStatsPath));
+    }
+#if GEM_PROFILE
+    if (options->profilePath) {
+        std::cout << '\n' << profiler.report(20);
+        gem::fs::write(profiler.collapsedStacks(),
+                       absolute(options->profilePath));
+    }
+#endif
+}
@@ -0,0 +1,66 @@
+#include "headless.hpp"
+
+#include <string>
+
+namespace gem {
+
+Screen::Screen(Window& window)
+    : window{window}, impl{std::make_unique<Impl>()} {}
+Screen::~Screen() = default;
+
+void Screen::vblank(const Frame* const frame) {
+    if (frame != nullptr) {
+        frame->convert(impl->format, impl->frame.data());
+    }
+    // counted either way
+    ++window.get().getImpl().frames;
+}
+
+Window::Window() : impl{std::make_unique<Impl>()} {}
+Window::~Window() = default;
+
+bool Window::isOpen() const {
+    return impl->open;
+}
+void Window::processEvents() {}
+
+namespace {
+// pixel `i` of a frame in `format`, widened back to 8 bits per channel
+std::array<u8, 3> rgb(const Frame::Format format,
+                      const u8* const frame,
+                      const usize i) {
+    switch (format) {
+        case Frame::Format::RGBA8888:
+            return {frame[i * 4], frame[i * 4 + 1], frame[i * 4 + 2]};
+        case Frame::Format::RGB565: {
+            const unsigned p = frame[i * 2] | (frame[i * 2 + 1] << 8u);
+            const auto widen = [](const unsigned v, const unsigned bits) {
+                return u8((v << (8 - bits)) | (v >> (2 * bits - 8)));
+            };
+            return {widen(p >> 11u, 5), widen((p >> 5u) & 0x3F, 6),
+                    widen(p & 0x1F, 5)};
+        }
+        case Frame::Format::Grey8:
+            return {frame[i], frame[i], frame[i]};
+    }
+    GEM_UNREACHABLE();
+}
+}  // namespace
+
+void headless::writePPM(const Screen& screen, const fs::AbsolutePath& path) {
+    const auto& [frame, format] = screen.getImpl();
+    std::string img = "P3\n" + std::to_string(Screen::Width) + ' ' +
+                      std::to_string(Screen::Height) + "\n255\n";
+    for (usize i = 0; i < Screen::Width * Screen::Height; ++i) {
+        for (const u8 c : rgb(format, frame.data(), i)) {
+            img += std::to_string(c);
+            img += ' ';
+        }
+        if ((i + 1) % Screen::Width == 0) {
+            img += '\n';
+        }
+    }
+    fs::write(img, path);
+}
+
+}  // namespace gem
@@ -0,0 +1,56 @@
+#include "idle_loops.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace gem {
+
+std::optional<IdleLoopOverrides> IdleLoopOverrides::load(
+      const fs::AbsolutePath& path,
+      const std::string_view title) {
+    std::ifstream in{path.path};
+    if (!in.is_open()) {
+        return std::nullopt;
+    }
+    IdleLoopOverrides overrides;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        const auto colon = line.rfind(':');
+        if (colon == std::string::npos) {
+            GEM_LOG("malformed idle loop override: '" << line << "'");
+            return std::nullopt;
+        }
+        std::istringstream words{line.substr(colon + 1)};
+        std::string word;
+        std::vector<u16> addresses;
+        bool off = false;
+        while (words >> word) {
+            if (word == "off") {
+                off = true;
+                continue;
+            }
+            char* end = nullptr;
+            const unsigned long address = std::strtoul(word.c_str(), &end, 16);
+            if (*end != '\0' || address > 0xFFFF) {
+                GEM_LOG("malformed idle loop override: '" << line << "'");
+                return std::nullopt;
+            }
+            addresses.push_back(u16(address));
+        }
+        if (std::string_view{line}.substr(0, colon) != title) {
+            continue;
+        }
+        overrides.disabled |= off;
+        for (const u16 address : addresses) {
+            overrides.ignored.insert(address);
+        }
+    }
+    return overrides;
+}
+
+}  // namespace gem
@@ -0,0 +1,30 @@
+#ifndef GEM_IDLE_LOOPS_HPP
+#define GEM_IDLE_LOOPS_HPP
+
+#include "fs.hpp"
+#include "fwd.hpp"
+
+#include <optional>
+#include <string_view>
+
+namespace gem {
+
+// games whose polling loops shouldn't be skipped. each line of an override
+// file names a ROM by its header title, then either `off` to never skip its
+// loops or the addresses of the loops to leave alone:
+//     # comments and blank lines are ignored
+//     TETRIS: off
+//     SUPER MARIOLAND: 0x0150 0x02A4
+struct IdleLoopOverrides {
+    bool disabled = false;
+    FlatSet<u16> ignored = {};
+
+    // the overrides for the ROM titled `title`, or nullopt if the file
+    // can't be read or is malformed
+    static std::optional<IdleLoopOverrides> load(const fs::AbsolutePath& path,
+                                                 std::string_view title);
+};
+
+}  // namespace gem
+
+#endif
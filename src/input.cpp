@@ -1,6 +1,6 @@
 #include "input.hpp"
 
-#include <SFML/Window/Keyboard.hpp>
+#include "sfml.hpp"
 
 #include <array>
 
@@ -18,9 +18,25 @@ const auto keyMapping = [] {
     mapping[idx(Input::Button::B)] = sf::Keyboard::Key::X;
     return mapping;
 }();
-}
+
+std::array<bool, 8> pressedButtons = {};
+}  // namespace
+
 bool Input::isButtonPressed(const Input::Button b) {
-    return sf::Keyboard::isKeyPressed(keyMapping[idx(b)]);
+    return pressedButtons[idx(b)];
+}
+
+std::optional<Input::Button> sfml::buttonForKey(const sf::Keyboard::Key key) {
+    for (usize b = 0; b < keyMapping.size(); ++b) {
+        if (keyMapping[b] == key) {
+            return Input::Button(b);
+        }
+    }
+    return std::nullopt;
+}
+
+void sfml::setButtonPressed(const Input::Button b, const bool pressed) {
+    pressedButtons[idx(b)] = pressed;
 }
 
 }  // namespace gem
@@ -4,8 +4,10 @@
 #include "input.hpp"
 #include "mem.hpp"
 #include "opcode.hpp"
+#include "scheduler.hpp"
 
 #include <array>
+#include <utility>
 
 namespace gem {
 
@@ -13,6 +15,24 @@ namespace {
 constexpr std::array<u8, 2> zeros{0x00, 0x00};
 constexpr std::array<u8, 2> ones{0xFF, 0xFF};
 std::array<u8, 2> garbage{0xFF, 0xFF};
+
+// DIV and TIMA both count in units of 4 ticks
+constexpr Ticks TimerUnit = 4;
+constexpr Ticks DIVPeriod = 16 * TimerUnit;
+
+Ticks getTIMAPeriod(const u8 tac) {
+    switch (tac & 0b11) {
+        case 0b00:
+            return 64 * TimerUnit;
+        case 0b01:
+            return 1 * TimerUnit;
+        case 0b10:
+            return 4 * TimerUnit;
+        case 0b11:
+            return 16 * TimerUnit;
+    }
+    GEM_UNREACHABLE();
+}
 }  // namespace
 
 const u8* IO::readOnlyRegisterPtr(const u16 address) const {
@@ -39,8 +59,6 @@ u8* IO::writableRegisterPtr(const u16 address) {
             return &this->timer;
         case Registers::TMA:
             return &this->tma;
-        case Registers::TAC:
-            return &this->tac;
         default:
             return blob.data() + (address - RegisterRange::Start);
     }
@@ -62,6 +80,12 @@ bool IO::consumeWrite(const u16 address, const u8 value) {
             return true;
         case Registers::DIV:
             this->div = 0x00;
+            GEM_ASSERT(scheduler != nullptr);
+            scheduler->schedule(Scheduler::Event::DIV,
+                                scheduler->now() + DIVPeriod);
+            return true;
+        case Registers::TAC:
+            setTAC(value);
             return true;
     }
     return false;
@@ -109,53 +133,40 @@ void IO::updateP1() {
     }
 }
 
-namespace {
-u16 getTimerThreshold(const u8 tac) {
-    switch (tac & 0b11) {
-        case 0b00:
-            return 64;
-        case 0b01:
-            return 1;
-        case 0b10:
-            return 4;
-        case 0b11:
-            return 16;
-    }
-    GEM_UNREACHABLE();
+void IO::setScheduler(Scheduler* const scheduler) {
+    this->scheduler = scheduler;
+    scheduler->schedule(Scheduler::Event::DIV, scheduler->now() + DIVPeriod);
 }
-}  // namespace
-
-void IO::update(Ticks ticks) {
-    timerSubCounter += ticks;
-    while (timerSubCounter > 4) {
-        ++timerCounter;
-        timerSubCounter -= 4;
 
-        divCounter = (divCounter + 1) % 16;
-        if (divCounter == 0) {
-            ++div;
-        }
+void IO::setTAC(const u8 value) {
+    const u8 old = std::exchange(tac, value);
+    if (((old ^ value) & 0b111) == 0) {
+        return;
     }
-    const auto timerThreshold = getTimerThreshold(tac);
-    while (timerCounter > timerThreshold) {
-        incTimer();
-        timerCounter -= timerThreshold;
+    GEM_ASSERT(scheduler != nullptr);
+    if (bitwise::test<2>(tac)) {
+        scheduler->schedule(Scheduler::Event::TIMA,
+                            scheduler->now() + getTIMAPeriod(tac));
+    } else {
+        scheduler->cancel(Scheduler::Event::TIMA);
     }
 }
 
-void IO::incTimer() {
-    if (bitwise::test<2>(tac)) {
-        const u16 newTimer = static_cast<u16>(timer) + 1;
+void IO::handleDIVEvent(const Ticks when) {
+    ++div;
+    scheduler->schedule(Scheduler::Event::DIV, when + DIVPeriod);
+}
 
-        const bool fireInterrupt = newTimer > 0xFF;
-        if (fireInterrupt) {
-            timer = tma;
-            GEM_ASSERT(mem != nullptr);
-            mem->interruptFlags.fireTimer();
-        } else {
-            timer = u8(newTimer);
-        }
+void IO::handleTIMAEvent(const Ticks when) {
+    GEM_ASSERT(bitwise::test<2>(tac));
+    if (timer == 0xFF) {
+        timer = tma;
+        GEM_ASSERT(mem != nullptr);
+        mem->interruptFlags.fireTimer();
+    } else {
+        ++timer;
     }
+    scheduler->schedule(Scheduler::Event::TIMA, when + getTIMAPeriod(tac));
 }
 
 }  // namespace gem
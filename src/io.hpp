@@ -6,6 +6,7 @@
 namespace gem {
 
 struct Mem;
+struct Scheduler;
 
 struct IO {
     enum Registers : u16 {
@@ -24,19 +25,27 @@ struct IO {
     };
 
     void setMem(Mem* const mem) { this->mem = mem; }
+    void setScheduler(Scheduler* scheduler);
 
     const u8* readOnlyRegisterPtr(const u16 address) const;
     u8* writableRegisterPtr(const u16 address);
 
     bool consumeWrite(const u16 address, const u8 value);
+    // whether consumeWrite() takes writes to `address`
+    static constexpr bool handlesWrite(const u16 address) {
+        return address == P1 || address == SB || address == SC ||
+               address == DIV || address == TAC;
+    }
 
-    void update(Ticks ticks);
+    void handleDIVEvent(Ticks when);
+    void handleTIMAEvent(Ticks when);
 
    private:
     void updateP1();
-    void incTimer();
+    void setTAC(u8 value);
 
     Mem* mem = nullptr;
+    Scheduler* scheduler = nullptr;
     u8 p1{0xFF};
     u8 sb;
     u8 div = 0x00;
@@ -44,10 +53,6 @@ struct IO {
     u8 tma = 0x00;
     u8 tac = 0x00;
 
-    Ticks timerCounter = 0x00;
-    Ticks timerSubCounter = 0x00;
-    Ticks divCounter = 0x00;
-
     std::array<u8, RegisterRange::End - RegisterRange::Start> blob;
 };
 
@@ -0,0 +1,1125 @@
+#include "jit.hpp"
+
+#if GEM_JIT
+
+#include "cpu.hpp"
+#include "mem.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+namespace gem {
+
+namespace {
+
+enum Reg : u8 {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+constexpr u8 NoIndex = 0xFF;
+
+enum class Size { Byte, Word, Dword, Qword };
+
+// the ALU ops that share an encoding, by their opcode extension
+enum class Alu : u8 { Add, Or, Adc, Sbb, And, Sub, Xor, Cmp };
+
+enum class Cond : u8 { B = 0x2, AE = 0x3, E = 0x4, NE = 0x5 };
+
+// a register, or memory at [base + index << scale + disp]
+struct RM {
+    u8 base = RAX;
+    bool memory = false;
+    u8 index = NoIndex;
+    u8 scale = 0;
+    i32 disp = 0;
+};
+RM reg(const u8 r) {
+    return RM{r, false, NoIndex, 0, 0};
+}
+RM at(const u8 base, const i32 disp = 0) {
+    return RM{base, true, NoIndex, 0, disp};
+}
+RM at(const u8 base, const u8 index, const u8 scale, const i32 disp) {
+    return RM{base, true, index, scale, disp};
+}
+
+struct Label {
+    usize id;
+};
+
+// just enough of an x86-64 assembler for JIT::compile
+struct Emitter {
+    std::vector<u8> bytes = {};
+    // where each label is bound, and the rel32s pointing at them
+    std::vector<usize> labels = {};
+    std::vector<std::pair<usize, usize>> fixups = {};
+
+    void raw(std::initializer_list<u8> bs) {
+        bytes.insert(bytes.end(), bs.begin(), bs.end());
+    }
+    template <typename T>
+    void imm(const T value) {
+        u8 buf[sizeof(T)];
+        std::memcpy(buf, &value, sizeof(T));
+        bytes.insert(bytes.end(), buf, buf + sizeof(T));
+    }
+    void imm(const Size size, const u32 value) {
+        switch (size) {
+            case Size::Byte:
+                imm(u8(value));
+                break;
+            case Size::Word:
+                imm(u16(value));
+                break;
+            case Size::Dword:
+            case Size::Qword:
+                imm(value);
+                break;
+        }
+    }
+
+    // an instruction with a ModRM byte. `r` is a register, or the opcode
+    // extension if `extension`.
+    void op(const Size size,
+            std::initializer_list<u8> opcode,
+            const u8 r,
+            const RM rm,
+            const bool extension = false) {
+        if (size == Size::Word) {
+            raw({0x66});
+        }
+        u8 rex = 0x40;
+        rex |= size == Size::Qword ? 0x08 : 0x00;
+        rex |= r >= 8 ? 0x04 : 0x00;
+        rex |= rm.memory && rm.index != NoIndex && rm.index >= 8 ? 0x02 : 0x00;
+        rex |= rm.base >= 8 ? 0x01 : 0x00;
+        // without one, byte registers 4-7 would be AH-BH rather than SPL-DIL
+        const auto high = [](const u8 x) { return x >= 4 && x < 8; };
+        const bool byteRex = size == Size::Byte &&
+                             ((!extension && high(r)) ||
+                              (!rm.memory && high(rm.base)));
+        if (rex != 0x40 || byteRex) {
+            raw({rex});
+        }
+        raw(opcode);
+        const u8 field = u8((r & 7u) << 3u);
+        if (!rm.memory) {
+            raw({u8(0xC0 | field | (rm.base & 7u))});
+            return;
+        }
+        const bool noDisp = rm.disp == 0 && (rm.base & 7u) != RBP;
+        const bool disp8 = -128 <= rm.disp && rm.disp <= 127;
+        const u8 mod = noDisp ? 0x00 : disp8 ? 0x40 : 0x80;
+        if (rm.index == NoIndex && (rm.base & 7u) != RSP) {
+            raw({u8(mod | field | (rm.base & 7u))});
+        } else {
+            const u8 index = rm.index == NoIndex ? u8(RSP) : rm.index;
+            raw({u8(mod | field | RSP),
+                 u8(rm.scale << 6u | (index & 7u) << 3u | (rm.base & 7u))});
+        }
+        if (!noDisp && disp8) {
+            imm(i8(rm.disp));
+        } else if (!noDisp) {
+            imm(rm.disp);
+        }
+    }
+
+    void mov(const Size size, const RM dst, const u8 src) {
+        op(size, {u8(size == Size::Byte ? 0x88 : 0x89)}, src, dst);
+    }
+    void load(const Size size, const u8 dst, const RM src) {
+        op(size, {u8(size == Size::Byte ? 0x8A : 0x8B)}, dst, src);
+    }
+    // into a 32-bit register, from a byte or a word
+    void movzx(const Size size, const u8 dst, const RM src) {
+        op(size == Size::Byte ? Size::Byte : Size::Dword,
+           {0x0F, u8(size == Size::Byte ? 0xB6 : 0xB7)}, dst, src);
+    }
+    // zero-extended to 64 bits
+    void movImm(const u8 dst, const u32 value) {
+        if (dst >= 8) {
+            raw({0x41});
+        }
+        raw({u8(0xB8 + (dst & 7u))});
+        imm(value);
+    }
+    template <typename T>
+    void movPtr(const u8 dst, T* const pointer) {
+        raw({u8(dst >= 8 ? 0x49 : 0x48), u8(0xB8 + (dst & 7u))});
+        imm(reinterpret_cast<std::uintptr_t>(pointer));
+    }
+    // a qword gets the value sign-extended from 32 bits
+    void store(const Size size, const RM dst, const u32 value) {
+        op(size, {u8(size == Size::Byte ? 0xC6 : 0xC7)}, 0, dst, true);
+        imm(size, value);
+    }
+    void alu(const Alu a, const Size size, const RM dst, const u8 src) {
+        op(size, {u8(u8(a) * 8u + (size == Size::Byte ? 0u : 1u))}, src, dst);
+    }
+    void alu(const Alu a, const Size size, const u8 dst, const RM src) {
+        op(size, {u8(u8(a) * 8u + (size == Size::Byte ? 2u : 3u))}, dst, src);
+    }
+    void aluImm(const Alu a, const Size size, const RM dst, const u32 value) {
+        op(size, {u8(size == Size::Byte ? 0x80 : 0x81)}, u8(a), dst, true);
+        imm(size == Size::Qword ? Size::Dword : size, value);
+    }
+    void test(const Size size, const RM a, const u8 b) {
+        op(size, {u8(size == Size::Byte ? 0x84 : 0x85)}, b, a);
+    }
+    void testImm(const RM a, const u8 value) {
+        op(Size::Byte, {0xF6}, 0, a, true);
+        imm(value);
+    }
+    void shl(const u8 r, const u8 n) {
+        op(Size::Dword, {0xC1}, 4, reg(r), true);
+        imm(n);
+    }
+    void setcc(const Cond c, const u8 r) {
+        op(Size::Byte, {0x0F, u8(0x90 + u8(c))}, 0, reg(r), true);
+    }
+    void lea(const u8 dst, const RM src) { op(Size::Qword, {0x8D}, dst, src); }
+    void push(const u8 r) {
+        if (r >= 8) {
+            raw({0x41});
+        }
+        raw({u8(0x50 + (r & 7u))});
+    }
+    void pop(const u8 r) {
+        if (r >= 8) {
+            raw({0x41});
+        }
+        raw({u8(0x58 + (r & 7u))});
+    }
+    template <typename T>
+    void call(T* const function) {
+        movPtr(RAX, function);
+        raw({0xFF, 0xD0});
+    }
+    void ret() { raw({0xC3}); }
+
+    Label label() {
+        labels.push_back(~usize{0});
+        return Label{labels.size() - 1};
+    }
+    void bind(const Label l) { labels[l.id] = bytes.size(); }
+    void jcc(const Cond c, const Label l) {
+        raw({0x0F, u8(0x80 + u8(c))});
+        rel32(l);
+    }
+    void jmp(const Label l) {
+        raw({0xE9});
+        rel32(l);
+    }
+    void rel32(const Label l) {
+        fixups.emplace_back(bytes.size(), l.id);
+        imm(i32{0});
+    }
+    void resolve() {
+        for (const auto& [patch, id] : fixups) {
+            GEM_ASSERT(labels[id] != ~usize{0});
+            const i32 rel = i32(i64(labels[id]) - i64(patch + 4));
+            std::memcpy(bytes.data() + patch, &rel, 4);
+        }
+    }
+};
+
+i32 offsetIn(const void* base, const void* member) {
+    const auto offset = reinterpret_cast<const u8*>(member) -
+                        reinterpret_cast<const u8*>(base);
+    GEM_ASSERT(offset >= 0 && offset <= 0x7FFFFFFF);
+    return i32(offset);
+}
+
+void protect(u8* const first, const usize size, const int protection) {
+    const auto pageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto begin = reinterpret_cast<std::uintptr_t>(first);
+    const std::uintptr_t pageStart = begin & ~(pageSize - 1);
+    if (mprotect(reinterpret_cast<void*>(pageStart), begin + size - pageStart,
+                 protection) != 0) {
+        throw std::runtime_error{"couldn't change the JIT's page protection"};
+    }
+}
+
+// what compiled code calls
+u8 readByte(const Mem& mem, const u16 address) {
+    return mem.read(address);
+}
+void writeByte(Mem& mem, const u16 address, const u8 value) {
+    mem.write(address, value);
+}
+void execute(CPU& cpu, const op::ExecFn exec, const u16 operand) {
+    cpu.retire(exec(cpu, operand));
+    cpu.afterInstruction();
+}
+bool zero(const FlagRegister& flags) {
+    return flags.getZ();
+}
+bool carry(const FlagRegister& flags) {
+    return flags.getC();
+}
+
+// the Game Boy's registers, and the host registers they're kept in between
+// calls. r8-r11 are caller-saved, so they're pushed around the calls that
+// don't change any Game Boy register, and reloaded after those that might.
+enum GBReg : u8 { A, B, C, D, E, H, L, SP, GBRegCount };
+constexpr std::array<u8, GBRegCount> Host = {R8,  R9,  R10, R11,
+                                             R12, R13, R14, R15};
+constexpr std::array<u8, 4> CallerSaved = {R8, R9, R10, R11};
+
+using Loc = op::Native::Loc;
+using Kind = op::Native::Kind;
+
+// the register a Loc names, if it's one
+bool single(const Loc loc, GBReg& r) {
+    switch (loc) {
+        case Loc::A:
+            r = A;
+            return true;
+        case Loc::B:
+            r = B;
+            return true;
+        case Loc::C:
+            r = C;
+            return true;
+        case Loc::D:
+            r = D;
+            return true;
+        case Loc::E:
+            r = E;
+            return true;
+        case Loc::H:
+            r = H;
+            return true;
+        case Loc::L:
+            r = L;
+            return true;
+        case Loc::SP:
+            r = SP;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// the pair a Loc names or addresses memory with, if it's one
+bool pair(const Loc loc, GBReg& high, GBReg& low) {
+    switch (loc) {
+        case Loc::BC:
+        case Loc::AtBC:
+            high = B;
+            low = C;
+            return true;
+        case Loc::DE:
+        case Loc::AtDE:
+            high = D;
+            low = E;
+            return true;
+        case Loc::HL:
+        case Loc::AtHL:
+            high = H;
+            low = L;
+            return true;
+        default:
+            return false;
+    }
+}
+
+u8 bit(const GBReg r) {
+    return u8(1u << r);
+}
+
+// the registers reading a Loc, or memory at it, takes
+u8 readers(const Loc loc) {
+    GBReg r = A, high = A, low = A;
+    if (single(loc, r)) {
+        return bit(r);
+    }
+    if (pair(loc, high, low)) {
+        return u8(bit(high) | bit(low));
+    }
+    return loc == Loc::AtHighC ? bit(C) : 0;
+}
+
+// the registers an instruction writes
+u8 writes(const op::Native& n) {
+    u8 mask = n.hlStep != 0 ? u8(bit(H) | bit(L)) : 0;
+    switch (n.kind) {
+        case Kind::Load:
+        case Kind::Load16:
+        case Kind::Inc:
+        case Kind::Dec:
+        case Kind::Inc16:
+        case Kind::Dec16: {
+            GBReg r = A, high = A, low = A;
+            if (single(n.dst, r)) {
+                mask |= bit(r);
+            } else if (n.dst == Loc::BC || n.dst == Loc::DE ||
+                       n.dst == Loc::HL) {
+                pair(n.dst, high, low);
+                mask |= u8(bit(high) | bit(low));
+            }
+            return mask;
+        }
+        case Kind::Add:
+        case Kind::Sub:
+        case Kind::And:
+        case Kind::Or:
+        case Kind::Xor:
+            return u8(mask | bit(A));
+        default:
+            return mask;
+    }
+}
+
+// the registers an instruction reads or writes
+u8 uses(const op::Native& n) {
+    u8 mask = u8(writes(n) | readers(n.src));
+    if (n.kind == Kind::Load) {
+        mask |= readers(n.dst);
+    } else if (n.kind == Kind::Cp) {
+        mask |= bit(A);
+    }
+    return mask;
+}
+
+}  // namespace
+
+// compiles one block
+struct JIT::Compiler {
+    using Lazy = FlagRegister::Lazy;
+
+    Compiler(CPU& cpu,
+             const bool& stale,
+             const u16 start,
+             const std::vector<BlockCache::MicroOp>& ops,
+             const std::vector<const op::DecodeInfo*>& infos)
+        : cpu{cpu}
+        , stale{stale}
+        , start{start}
+        , ops{ops}
+        , infos{infos}
+        , hook{cpu.getInstructionHook()}
+        , hookContext{cpu.getInstructionHookContext()} {
+        const Registers& r = cpu.reg;
+        regs = {offsetIn(&cpu, &r.A), offsetIn(&cpu, &r.B),
+                offsetIn(&cpu, &r.C), offsetIn(&cpu, &r.D),
+                offsetIn(&cpu, &r.E), offsetIn(&cpu, &r.H),
+                offsetIn(&cpu, &r.L), offsetIn(&cpu, &r.SP)};
+        pc = offsetIn(&cpu, &r.PC);
+        flagsAt = offsetIn(&cpu, &r.flags);
+        flagsR = offsetIn(&cpu, &r.flags.r);
+        lazy = offsetIn(&cpu, &r.flags.lazy);
+        lhs = offsetIn(&cpu, &r.flags.lazyLhs);
+        rhs = offsetIn(&cpu, &r.flags.lazyRhs);
+        result = offsetIn(&cpu, &r.flags.lazyResult);
+        ticks = offsetIn(&cpu, &cpu.ticks);
+        deltaTicks = offsetIn(&cpu, &cpu.deltaTicks);
+        readPages = offsetIn(&cpu.bus, cpu.bus.readPages.data());
+        writePages = offsetIn(&cpu.bus, cpu.bus.writePages.data());
+        ioWritten = offsetIn(&cpu.bus, &cpu.bus.ioWritten);
+
+        bool native = true;
+        bool pure = true;
+        for (usize i = 0; i < ops.size(); ++i) {
+            const op::Native& n = infos[i]->native;
+            used |= uses(n);
+            modified |= writes(n);
+            native = native && n.kind != Kind::Call;
+            pure = pure && infos[i]->pure;
+        }
+        const op::Native& last = infos.back()->native;
+        loops = hook == nullptr && native && last.kind == Kind::Jump &&
+                last.src != Loc::HL && target(ops.back(), last) == start &&
+                (!pure || changesEveryPass());
+    }
+
+    Compiler(const Compiler&) = delete;
+    Compiler& operator=(const Compiler&) = delete;
+
+    std::vector<u8> compile() {
+        // rbx = &cpu, rbp = &cpu.bus. [rsp] holds the ticks at the start,
+        // [rsp + 8] the ticks the budget runs out at.
+        pushed = {RBX, RBP};
+        for (const GBReg r : {E, H, L, SP}) {
+            if ((used & bit(r)) != 0) {
+                pushed.push_back(Host[r]);
+            }
+        }
+        frame = pushed.size() % 2 == 0 ? 24 : 16;
+        for (const u8 r : pushed) {
+            e.push(r);
+        }
+        e.aluImm(Alu::Sub, Size::Qword, reg(RSP), frame);
+        e.movPtr(RBX, &cpu);
+        e.movPtr(RBP, &cpu.bus);
+        e.load(Size::Qword, RAX, at(RBX, ticks));
+        e.mov(Size::Qword, at(RSP), RAX);
+        e.alu(Alu::Add, Size::Qword, reg(RAX), RDI);
+        e.mov(Size::Qword, at(RSP, 8), RAX);
+        reload();
+        e.bind(top);
+
+        for (usize i = 0; i < ops.size(); ++i) {
+            instruction(ops[i], *infos[i], i + 1 == ops.size());
+        }
+        // stubs can add more
+        for (usize i = 0; i < cold.size(); ++i) {
+            cold[i]();
+        }
+
+        e.bind(done);
+        e.load(Size::Qword, RAX, at(RBX, ticks));
+        e.alu(Alu::Sub, Size::Qword, RAX, at(RSP));
+        e.aluImm(Alu::Add, Size::Qword, reg(RSP), frame);
+        for (auto r = pushed.rbegin(); r != pushed.rend(); ++r) {
+            e.pop(*r);
+        }
+        e.ret();
+        e.resolve();
+        return std::move(e.bytes);
+    }
+
+   private:
+    // a value to store or operate with: a host register, or an immediate
+    struct Value {
+        bool immediate = false;
+        u8 r = RAX;
+        u8 n = 0;
+    };
+
+    // what's known of the flags while compiling: which operation the lazy
+    // record is sure to hold, if any
+    enum class Flags { Unknown, Add, Sub, And, Or, Inc, Dec };
+
+    static u16 target(const BlockCache::MicroOp& op, const op::Native& n) {
+        if (n.src == Loc::Relative) {
+            return u16(op.nextPC + i8(u8(op.operand)));
+        }
+        return op.operand;
+    }
+
+    // a pure block can only go round without returning if it can't be an
+    // idle loop, which it can't if one of its instructions steps a register
+    // nothing else in it writes
+    bool changesEveryPass() const {
+        for (usize i = 0; i < ops.size(); ++i) {
+            const op::Native& n = infos[i]->native;
+            const bool steps = n.kind == Kind::Inc || n.kind == Kind::Dec ||
+                               n.kind == Kind::Inc16 ||
+                               n.kind == Kind::Dec16 || n.hlStep != 0;
+            if (!steps) {
+                continue;
+            }
+            bool alone = true;
+            for (usize k = 0; k < ops.size(); ++k) {
+                alone = alone && (k == i || (writes(infos[k]->native) &
+                                             writes(n)) == 0);
+            }
+            if (alone) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void instruction(const BlockCache::MicroOp& op,
+                     const op::DecodeInfo& info,
+                     const bool last) {
+        const op::Native& n = info.native;
+        GBReg r = A, high = A, low = A;
+        switch (n.kind) {
+            case Kind::Call:
+                fallback(op, last);
+                return;
+            case Kind::Nop:
+                break;
+            case Kind::Load:
+                if (single(n.dst, r)) {
+                    const Value v = source(n, op);
+                    if (v.immediate) {
+                        e.movImm(Host[r], v.n);
+                    } else if (v.r != Host[r]) {
+                        e.mov(Size::Dword, reg(Host[r]), v.r);
+                    }
+                } else {
+                    write(n, op, source(n, op));
+                }
+                break;
+            case Kind::Load16:
+                if (pair(n.dst, high, low)) {
+                    e.movImm(Host[high], op.operand >> 8u);
+                    e.movImm(Host[low], op.operand & 0xFFu);
+                } else {
+                    e.movImm(Host[SP], op.operand);
+                }
+                break;
+            case Kind::Add:
+            case Kind::Sub:
+            case Kind::Cp:
+                arithmetic(n.kind, source(n, op));
+                break;
+            case Kind::And:
+            case Kind::Or:
+            case Kind::Xor:
+                logic(n.kind, source(n, op));
+                break;
+            case Kind::Inc:
+            case Kind::Dec:
+                single(n.dst, r);
+                keepCarry();
+                e.aluImm(n.kind == Kind::Inc ? Alu::Add : Alu::Sub, Size::Byte,
+                         reg(Host[r]), 1);
+                record(n.kind == Kind::Inc ? Lazy::Inc : Lazy::Dec, Host[r]);
+                flags = n.kind == Kind::Inc ? Flags::Inc : Flags::Dec;
+                break;
+            case Kind::Inc16:
+            case Kind::Dec16:
+                step(n.dst, n.kind == Kind::Inc16 ? 1 : -1);
+                break;
+            case Kind::Jump:
+                jump(op, info);
+                return;
+        }
+        if (n.hlStep != 0) {
+            step(Loc::HL, n.hlStep);
+        }
+        const DeltaTicks t = n.ticks;
+        if (last) {
+            exit(op.nextPC, pending + t, t);
+            return;
+        }
+        if (hook != nullptr) {
+            spill();
+            e.store(Size::Word, at(RBX, pc), op.nextPC);
+            e.aluImm(Alu::Add, Size::Qword, at(RBX, ticks), u32(pending + t));
+            e.store(Size::Qword, at(RBX, deltaTicks), u32(t));
+            pending = 0;
+            callHook();
+            exitIfOutOfTime(done);
+            return;
+        }
+        pending += t;
+        const Label out = e.label();
+        const DeltaTicks p = pending;
+        exitIfOutOfTime(out);
+        later([=] {
+            e.bind(out);
+            exit(op.nextPC, p, t);
+        });
+    }
+
+    // anything op::Native doesn't describe goes through exec_, with the
+    // registers in memory
+    void fallback(const BlockCache::MicroOp& op, const bool last) {
+        spill();
+        e.store(Size::Word, at(RBX, pc), op.nextPC);
+        syncTicks();
+        e.mov(Size::Qword, reg(RDI), RBX);
+        e.movPtr(RSI, op.exec);
+        e.movImm(RDX, op.operand);
+        e.call(&execute);
+        reload();
+        flags = Flags::Unknown;
+        if (last) {
+            e.jmp(done);
+        } else {
+            exitIfInterrupted(done);
+            exitIfOutOfTime(done);
+        }
+    }
+
+    void jump(const BlockCache::MicroOp& op, const op::DecodeInfo& info) {
+        const op::Native& n = info.native;
+        if (n.condition != op::Native::Condition::Always) {
+            const Label taken = e.label();
+            branchIf(n.condition, taken);
+            exit(op.nextPC, pending + n.ticks, n.ticks);
+            e.bind(taken);
+        }
+        const DeltaTicks t = info.maxTicks;
+        if (n.src == Loc::HL) {
+            spill();
+            address(RAX, H, L);
+            e.mov(Size::Word, at(RBX, pc), RAX);
+            finishExit(pending + t, t);
+            return;
+        }
+        const u16 to = target(op, n);
+        if (loops && to == start) {
+            // round again while there's budget left
+            e.aluImm(Alu::Add, Size::Qword, at(RBX, ticks), u32(pending + t));
+            e.load(Size::Qword, RAX, at(RBX, ticks));
+            e.alu(Alu::Cmp, Size::Qword, RAX, at(RSP, 8));
+            e.jcc(Cond::B, top);
+            exit(to, 0, t);
+            return;
+        }
+        exit(to, pending + t, t);
+    }
+
+    // leaves the block with PC at `to`, once `add` more ticks have passed,
+    // the last instruction having taken `delta`
+    void exit(const u16 to, const DeltaTicks add, const DeltaTicks delta) {
+        spill();
+        e.store(Size::Word, at(RBX, pc), to);
+        finishExit(add, delta);
+    }
+    void finishExit(const DeltaTicks add, const DeltaTicks delta) {
+        if (add != 0) {
+            e.aluImm(Alu::Add, Size::Qword, at(RBX, ticks), u32(add));
+        }
+        e.store(Size::Qword, at(RBX, deltaTicks), u32(delta));
+        callHook();
+        e.jmp(done);
+    }
+
+    // after an instruction, like CPU::continueRun(), with `pending` ticks
+    // not yet in cpu.ticks
+    void exitIfOutOfTime(const Label exit) {
+        e.load(Size::Qword, RAX, at(RBX, ticks));
+        if (pending != 0) {
+            e.aluImm(Alu::Add, Size::Qword, reg(RAX), u32(pending));
+        }
+        e.alu(Alu::Cmp, Size::Qword, RAX, at(RSP, 8));
+        e.jcc(Cond::AE, exit);
+    }
+
+    // after something that may have written to an IO register or to code
+    void exitIfInterrupted(const Label exit) {
+        e.aluImm(Alu::Cmp, Size::Byte, at(RBP, ioWritten), 0);
+        e.jcc(Cond::NE, exit);
+        e.movPtr(RAX, &stale);
+        e.aluImm(Alu::Cmp, Size::Byte, at(RAX), 0);
+        e.jcc(Cond::NE, exit);
+    }
+
+    Value source(const op::Native& n, const BlockCache::MicroOp& op) {
+        GBReg r = A;
+        if (single(n.src, r)) {
+            return Value{false, Host[r], 0};
+        }
+        if (n.src == Loc::Operand) {
+            return Value{true, RAX, u8(op.operand)};
+        }
+        read(n.src, op.operand);
+        return Value{false, RAX, 0};
+    }
+
+    // into eax
+    void read(const Loc loc, const u16 operand) {
+        GBReg high = A, low = A;
+        if (pair(loc, high, low)) {
+            const Label slow = e.label();
+            const Label back = e.label();
+            e.load(Size::Qword, RDX, at(RBP, Host[high], 3, readPages));
+            e.test(Size::Qword, reg(RDX), RDX);
+            e.jcc(Cond::E, slow);
+            e.movzx(Size::Byte, RAX, at(RDX, Host[low], 0, 0));
+            e.bind(back);
+            later([=] {
+                e.bind(slow);
+                address(RSI, high, low);
+                callRead();
+                e.jmp(back);
+            });
+            return;
+        }
+        if (loc == Loc::AtHighC) {
+            e.mov(Size::Dword, reg(RSI), Host[C]);
+            e.aluImm(Alu::Or, Size::Dword, reg(RSI), 0xFF00);
+            callRead();
+            return;
+        }
+        const u16 a = loc == Loc::AtHighOperand ? u16(0xFF00 | (operand & 0xFF))
+                                                : operand;
+        if (a >> 8u == 0xFF) {
+            // never mapped, but always the same memory
+            e.movPtr(RAX, cpu.bus.ptrSlow(a));
+            e.movzx(Size::Byte, RAX, at(RAX));
+            return;
+        }
+        const Label slow = e.label();
+        const Label back = e.label();
+        e.load(Size::Qword, RDX, at(RBP, readPages + 8 * (a >> 8u)));
+        e.test(Size::Qword, reg(RDX), RDX);
+        e.jcc(Cond::E, slow);
+        e.movzx(Size::Byte, RAX, at(RDX, a & 0xFF));
+        e.bind(back);
+        later([=] {
+            e.bind(slow);
+            e.movImm(RSI, a);
+            callRead();
+            e.jmp(back);
+        });
+    }
+
+    void write(const op::Native& n,
+               const BlockCache::MicroOp& op,
+               const Value v) {
+        // where to go if the write interrupts the block: the rest of the
+        // instruction still happens
+        const Label interrupted = e.label();
+        const DeltaTicks p = pending;
+        later([=] {
+            e.bind(interrupted);
+            if (n.hlStep != 0) {
+                step(Loc::HL, n.hlStep);
+            }
+            exit(op.nextPC, p + n.ticks, n.ticks);
+        });
+
+        GBReg high = A, low = A;
+        u16 a = 0;
+        if (pair(n.dst, high, low)) {
+            const Label slow = e.label();
+            const Label back = e.label();
+            e.load(Size::Qword, RDX, at(RBP, Host[high], 3, writePages));
+            e.test(Size::Qword, reg(RDX), RDX);
+            e.jcc(Cond::E, slow);
+            storeTo(at(RDX, Host[low], 0, 0), v);
+            e.bind(back);
+            later([=] {
+                e.bind(slow);
+                address(RSI, high, low);
+                callWrite(v, p);
+                exitIfInterrupted(interrupted);
+                e.jmp(back);
+            });
+            return;
+        }
+        if (n.dst == Loc::AtHighC) {
+            e.mov(Size::Dword, reg(RSI), Host[C]);
+            e.aluImm(Alu::Or, Size::Dword, reg(RSI), 0xFF00);
+            callWrite(v, p);
+            exitIfInterrupted(interrupted);
+            return;
+        }
+        a = n.dst == Loc::AtHighOperand ? u16(0xFF00 | (op.operand & 0xFF))
+                                        : op.operand;
+        if (a >> 8u == 0xFF) {
+            e.movImm(RSI, a);
+            callWrite(v, p);
+            exitIfInterrupted(interrupted);
+            return;
+        }
+        const Label slow = e.label();
+        const Label back = e.label();
+        e.load(Size::Qword, RDX, at(RBP, writePages + 8 * (a >> 8u)));
+        e.test(Size::Qword, reg(RDX), RDX);
+        e.jcc(Cond::E, slow);
+        storeTo(at(RDX, a & 0xFF), v);
+        e.bind(back);
+        later([=] {
+            e.bind(slow);
+            e.movImm(RSI, a);
+            callWrite(v, p);
+            exitIfInterrupted(interrupted);
+            e.jmp(back);
+        });
+    }
+
+    // A op= v, keeping the operands for the flags
+    void arithmetic(const Kind kind, const Value v) {
+        e.mov(Size::Byte, at(RBX, lhs), Host[A]);
+        storeTo(at(RBX, rhs), v);
+        const u8 r = kind == Kind::Cp ? u8(RCX) : Host[A];
+        if (kind == Kind::Cp) {
+            e.mov(Size::Dword, reg(RCX), Host[A]);
+        }
+        aluWith(kind == Kind::Add ? Alu::Add : Alu::Sub, r, v);
+        record(kind == Kind::Add ? Lazy::Add : Lazy::Sub, r);
+        flags = kind == Kind::Add ? Flags::Add : Flags::Sub;
+    }
+
+    void logic(const Kind kind, const Value v) {
+        aluWith(kind == Kind::And  ? Alu::And
+                : kind == Kind::Or ? Alu::Or
+                                   : Alu::Xor,
+                Host[A], v);
+        record(kind == Kind::And ? Lazy::And : Lazy::Or, Host[A]);
+        flags = kind == Kind::And ? Flags::And : Flags::Or;
+    }
+
+    void aluWith(const Alu a, const u8 r, const Value v) {
+        if (v.immediate) {
+            e.aluImm(a, Size::Byte, reg(r), v.n);
+        } else {
+            e.alu(a, Size::Byte, reg(r), v.r);
+        }
+    }
+
+    void storeTo(const RM dst, const Value v) {
+        if (v.immediate) {
+            e.store(Size::Byte, dst, v.n);
+        } else {
+            e.mov(Size::Byte, dst, v.r);
+        }
+    }
+
+    void record(const Lazy op, const u8 r) {
+        e.mov(Size::Byte, at(RBX, result), r);
+        e.store(Size::Byte, at(RBX, lazy), u8(op));
+    }
+
+    // INC and DEC leave C alone, so it's moved to the plain register first
+    void keepCarry() {
+        switch (flags) {
+            case Flags::Add:
+            case Flags::Sub:
+                carryInto(RAX);
+                e.setcc(Cond::B, RAX);
+                e.shl(RAX, 4);
+                e.mov(Size::Byte, at(RBX, flagsR), RAX);
+                return;
+            case Flags::And:
+            case Flags::Or:
+                e.store(Size::Byte, at(RBX, flagsR), 0);
+                return;
+            case Flags::Inc:
+            case Flags::Dec:
+                return;
+            case Flags::Unknown:
+                callFlags(&carry);
+                e.shl(RAX, 4);
+                e.mov(Size::Byte, at(RBX, flagsR), RAX);
+                return;
+        }
+    }
+
+    // compares so that the host's carry is the Game Boy's, after an Add or
+    // a Sub
+    void carryInto(const u8 r) {
+        if (flags == Flags::Add) {
+            e.movzx(Size::Byte, r, at(RBX, result));
+            e.alu(Alu::Cmp, Size::Byte, r, at(RBX, lhs));
+        } else {
+            e.movzx(Size::Byte, r, at(RBX, lhs));
+            e.alu(Alu::Cmp, Size::Byte, r, at(RBX, rhs));
+        }
+    }
+
+    void branchIf(const op::Native::Condition condition, const Label taken) {
+        using Condition = op::Native::Condition;
+        const bool set = condition == Condition::Z || condition == Condition::C;
+        if (condition == Condition::Z || condition == Condition::NZ) {
+            if (flags == Flags::Unknown) {
+                callFlags(&zero);
+                e.test(Size::Byte, reg(RAX), RAX);
+                e.jcc(set ? Cond::NE : Cond::E, taken);
+            } else {
+                e.aluImm(Alu::Cmp, Size::Byte, at(RBX, result), 0);
+                e.jcc(set ? Cond::E : Cond::NE, taken);
+            }
+            return;
+        }
+        switch (flags) {
+            case Flags::Add:
+            case Flags::Sub:
+                carryInto(RAX);
+                e.jcc(set ? Cond::B : Cond::AE, taken);
+                return;
+            case Flags::And:
+            case Flags::Or:
+                if (!set) {
+                    e.jmp(taken);
+                }
+                return;
+            case Flags::Inc:
+            case Flags::Dec:
+                e.testImm(at(RBX, flagsR), 0x10);
+                e.jcc(set ? Cond::NE : Cond::E, taken);
+                return;
+            case Flags::Unknown:
+                callFlags(&carry);
+                e.test(Size::Byte, reg(RAX), RAX);
+                e.jcc(set ? Cond::NE : Cond::E, taken);
+                return;
+        }
+    }
+
+    // INC and DEC of a pair or SP, or LDI and LDD's step of HL
+    void step(const Loc loc, const int by) {
+        GBReg high = A, low = A;
+        if (pair(loc, high, low)) {
+            e.aluImm(by > 0 ? Alu::Add : Alu::Sub, Size::Byte,
+                     reg(Host[low]), 1);
+            e.aluImm(by > 0 ? Alu::Adc : Alu::Sbb, Size::Byte,
+                     reg(Host[high]), 0);
+        } else {
+            e.aluImm(by > 0 ? Alu::Add : Alu::Sub, Size::Word, reg(Host[SP]),
+                     1);
+        }
+    }
+
+    void address(const u8 dst, const GBReg high, const GBReg low) {
+        e.mov(Size::Dword, reg(dst), Host[high]);
+        e.shl(dst, 8);
+        e.alu(Alu::Or, Size::Dword, reg(dst), Host[low]);
+    }
+
+    // with the address in esi
+    void callRead() {
+        e.mov(Size::Qword, reg(RDI), RBP);
+        callKeeping(&readByte);
+        e.movzx(Size::Byte, RAX, reg(RAX));
+    }
+    // with the address in esi. devices can look at the clock, so it's
+    // brought up to date for the call.
+    void callWrite(const Value v, const DeltaTicks p) {
+        if (v.immediate) {
+            e.movImm(RDX, v.n);
+        } else {
+            e.mov(Size::Dword, reg(RDX), v.r);
+        }
+        e.mov(Size::Qword, reg(RDI), RBP);
+        if (p != 0) {
+            e.aluImm(Alu::Add, Size::Qword, at(RBX, ticks), u32(p));
+        }
+        callKeeping(&writeByte);
+        if (p != 0) {
+            e.aluImm(Alu::Sub, Size::Qword, at(RBX, ticks), u32(p));
+        }
+    }
+    // into eax
+    void callFlags(bool (*const function)(const FlagRegister&)) {
+        e.lea(RDI, at(RBX, flagsAt));
+        callKeeping(function);
+        e.movzx(Size::Byte, RAX, reg(RAX));
+    }
+    // with the registers in memory
+    void callHook() {
+        if (hook == nullptr) {
+            return;
+        }
+        e.movPtr(RDI, hookContext);
+        e.mov(Size::Qword, reg(RSI), RBX);
+        callKeeping(hook);
+    }
+    template <typename T>
+    void callKeeping(T* const function) {
+        for (const u8 r : CallerSaved) {
+            e.push(r);
+        }
+        e.call(function);
+        for (auto r = CallerSaved.rbegin(); r != CallerSaved.rend(); ++r) {
+            e.pop(*r);
+        }
+    }
+
+    void spill() {
+        for (u8 r = 0; r < GBRegCount; ++r) {
+            if ((modified & bit(GBReg(r))) != 0) {
+                e.mov(r == SP ? Size::Word : Size::Byte, at(RBX, regs[r]),
+                      Host[r]);
+            }
+        }
+    }
+    void reload() {
+        for (u8 r = 0; r < GBRegCount; ++r) {
+            if ((used & bit(GBReg(r))) != 0) {
+                e.movzx(r == SP ? Size::Word : Size::Byte, Host[r],
+                        at(RBX, regs[r]));
+            }
+        }
+    }
+    void syncTicks() {
+        if (pending != 0) {
+            e.aluImm(Alu::Add, Size::Qword, at(RBX, ticks), u32(pending));
+            pending = 0;
+        }
+    }
+
+    // emitted after the block, out of the way of the common path
+    void later(std::function<void()> stub) { cold.push_back(std::move(stub)); }
+
+    CPU& cpu;
+    const bool& stale;
+    const u16 start;
+    const std::vector<BlockCache::MicroOp>& ops;
+    const std::vector<const op::DecodeInfo*>& infos;
+    const CPU::InstructionHook hook;
+    void* const hookContext;
+
+    std::array<i32, GBRegCount> regs = {};
+    i32 pc = 0, flagsAt = 0, flagsR = 0, lazy = 0, lhs = 0, rhs = 0,
+        result = 0;
+    i32 ticks = 0, deltaTicks = 0;
+    i32 readPages = 0, writePages = 0, ioWritten = 0;
+
+    // Game Boy registers the block touches, and those it changes
+    u8 used = 0;
+    u8 modified = 0;
+    // whether the block jumps straight back to its start
+    bool loops = false;
+
+    Emitter e = {};
+    std::vector<std::function<void()>> cold = {};
+    std::vector<u8> pushed = {};
+    u32 frame = 0;
+    Label top = e.label();
+    Label done = e.label();
+    // ticks of the instructions compiled so far that aren't in cpu.ticks
+    DeltaTicks pending = 0;
+    Flags flags = Flags::Unknown;
+};
+
+JIT::JIT() {
+    // never writable and executable at once: compile() unlocks just the
+    // pages it writes, and locks them again before handing the code out
+    void* const mem = mmap(nullptr, CodeSize, PROT_READ | PROT_EXEC,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        throw std::runtime_error{"couldn't map memory for the JIT"};
+    }
+    code = static_cast<u8*>(mem);
+}
+
+JIT::~JIT() {
+    munmap(code, CodeSize);
+}
+
+BlockCache::NativeBlock JIT::compile(
+      CPU& cpu,
+      const bool& stale,
+      const u16 start,
+      const std::vector<BlockCache::MicroOp>& ops,
+      const std::vector<const op::DecodeInfo*>& infos) {
+    GEM_ASSERT(!ops.empty() && ops.size() == infos.size());
+    const std::vector<u8> bytes =
+          Compiler{cpu, stale, start, ops, infos}.compile();
+    if (used + bytes.size() > CodeSize) {
+        return nullptr;
+    }
+    u8* const begin = code + used;
+    protect(begin, bytes.size(), PROT_READ | PROT_WRITE);
+    std::memcpy(begin, bytes.data(), bytes.size());
+    protect(begin, bytes.size(), PROT_READ | PROT_EXEC);
+    used += bytes.size();
+    // keep blocks cache-line aligned
+    used = (used + 63) & ~usize{63};
+    return reinterpret_cast<BlockCache::NativeBlock>(begin);
+}
+
+}  // namespace gem
+
+#endif
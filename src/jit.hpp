@@ -0,0 +1,57 @@
+#ifndef GEM_JIT_HPP
+#define GEM_JIT_HPP
+
+#include "fwd.hpp"
+
+#include "block_cache.hpp"
+
+#include <vector>
+
+#if GEM_JIT
+
+namespace gem {
+
+struct CPU;
+
+// compiles cached blocks to x86-64. loads, 8-bit ALU ops, INC/DEC and jumps
+// are translated from what gen_opcodes.py makes of their implementations
+// (op::Native), with A-L and SP kept in host registers and memory accessed
+// through Mem's page tables inline; every other instruction calls its exec_
+// function. a block that jumps back to its own start goes round again
+// without returning, as long as the budget allows and it can't be an idle
+// loop.
+//
+// the code is specialised for the CPU's instruction hook at the time it's
+// compiled, so the block cache drops it all when the hook changes.
+struct JIT {
+    JIT();
+    ~JIT();
+
+    JIT(const JIT&) = delete;
+    JIT& operator=(const JIT&) = delete;
+
+    // null if the code buffer is full. `infos` are what `ops` were decoded
+    // from, `start` the PC of the first.
+    BlockCache::NativeBlock compile(
+          CPU& cpu,
+          const bool& stale,
+          u16 start,
+          const std::vector<BlockCache::MicroOp>& ops,
+          const std::vector<const op::DecodeInfo*>& infos);
+
+    // forgets all compiled code
+    void flush() { used = 0; }
+
+   private:
+    struct Compiler;
+
+    static constexpr usize CodeSize = 8 << 20;
+    u8* code = nullptr;
+    usize used = 0;
+};
+
+}  // namespace gem
+
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+#include "layer_cache.hpp"
+
+#include "pixels.hpp"
+
+#include <cstring>
+
+namespace gem {
+
+namespace {
+// where the tile maps start in VRAM
+constexpr usize MapsStart = 0x1800;
+}  // namespace
+
+LayerCache::LayerCache() {
+    for (Layer& layer : layers) {
+        layer.pixels.resize(Size * Size);
+        layer.staleRows.set();
+    }
+}
+
+void LayerCache::update(Layer& layer,
+                        const u8* const vram,
+                        const TileAtlas& atlas,
+                        const usize map,
+                        const bool signedTiles,
+                        const usize tileRow) {
+    if (layer.changedTiles.any()) {
+        for (usize entry = 0; entry < layer.tiles.size(); ++entry) {
+            if (layer.changedTiles.test(layer.tiles[entry])) {
+                layer.staleRows.set(entry / MapTiles);
+            }
+        }
+        layer.changedTiles.reset();
+    }
+    if (layer.staleRows.test(tileRow)) {
+        redraw(layer, vram, atlas, map, signedTiles, tileRow);
+        layer.staleRows.reset(tileRow);
+    }
+}
+
+void LayerCache::redraw(Layer& layer,
+                        const u8* const vram,
+                        const TileAtlas& atlas,
+                        const usize map,
+                        const bool signedTiles,
+                        const usize tileRow) {
+    const usize first = tileRow * MapTiles;
+    const u8* const entries = vram + MapsStart + map * 0x400 + first;
+    for (usize col = 0; col < MapTiles; ++col) {
+        i8 signedValue;
+        std::memcpy(&signedValue, &entries[col], sizeof signedValue);
+        const u16 tile =
+              signedTiles ? u16(256 + signedValue) : u16(entries[col]);
+        layer.tiles[first + col] = tile;
+        for (unsigned y = 0; y < 8; ++y) {
+            const pixels::Row& row = atlas.row(tile, y);
+            std::memcpy(&layer.pixels[(tileRow * 8 + y) * Size + col * 8],
+                        row.data(), row.size());
+        }
+    }
+}
+
+}  // namespace gem
@@ -0,0 +1,85 @@
+#ifndef GEM_LAYER_CACHE_HPP
+#define GEM_LAYER_CACHE_HPP
+
+#include "fwd.hpp"
+
+#include "tile_atlas.hpp"
+
+#include <array>
+#include <bitset>
+#include <vector>
+
+namespace gem {
+
+// both tile maps drawn out in full as 256x256 bitmaps of colour codes, once
+// for each way of addressing tile data. a line of background or window is
+// then just a row of one of them. map entries and tiles that change only
+// mark the tile rows showing them stale; those are drawn again the next time
+// they're read.
+struct LayerCache {
+    static constexpr usize Size = 256;
+    // map entries per row and per column
+    static constexpr usize MapTiles = 32;
+
+    LayerCache();
+
+    // after a write to tile `tile` of the atlas
+    void invalidateTile(const usize tile) {
+        for (Layer& layer : layers) {
+            layer.changedTiles.set(tile);
+        }
+    }
+    // after a write to the tile maps, `offset` relative to the first one
+    void invalidateMapEntry(const u16 offset) {
+        const usize map = offset / (MapTiles * MapTiles);
+        const usize row = (offset / MapTiles) % MapTiles;
+        layers[map * 2].staleRows.set(row);
+        layers[map * 2 + 1].staleRows.set(row);
+    }
+
+    // line `y` of tile map `map` (0 at 0x9800, 1 at 0x9C00): Size colour
+    // codes, left to right. with `signedTiles` the map's entries count from
+    // tile 256 (0x9000) rather than tile 0. `atlas` must be up to date.
+    const u8* row(const u8* const vram,
+                  const TileAtlas& atlas,
+                  const usize map,
+                  const bool signedTiles,
+                  const unsigned y) {
+        Layer& layer = layers[map * 2 + (signedTiles ? 1 : 0)];
+        if (layer.changedTiles.any() || layer.staleRows.test(y / 8)) {
+            update(layer, vram, atlas, map, signedTiles, y / 8);
+        }
+        return layer.pixels.data() + y * Size;
+    }
+
+   private:
+    struct Layer {
+        std::vector<u8> pixels = {};
+        // the tile drawn for each map entry
+        std::array<u16, MapTiles * MapTiles> tiles = {};
+        std::bitset<MapTiles> staleRows = {};
+        // tiles written since they were last looked for in `tiles`
+        std::bitset<TileAtlas::Tiles> changedTiles = {};
+    };
+
+    // brings tile row `tileRow` of `layer` up to date
+    void update(Layer& layer,
+                const u8* vram,
+                const TileAtlas& atlas,
+                usize map,
+                bool signedTiles,
+                usize tileRow);
+    void redraw(Layer& layer,
+                const u8* vram,
+                const TileAtlas& atlas,
+                usize map,
+                bool signedTiles,
+                usize tileRow);
+
+    // indexed by map * 2 + signedTiles
+    std::array<Layer, 4> layers = {};
+};
+
+}  // namespace gem
+
+#endif
@@ -1,12 +1,16 @@
-#include "cpu.hpp"
 #include "fs.hpp"
-#include "gpu.hpp"
-#include "io.hpp"
-#include "mem.hpp"
+#include "gameboy.hpp"
+#include "pacer.hpp"
 #include "rom.hpp"
 #include "screen.hpp"
+#include "sfml.hpp"
 
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 int main(int argc, const char* argv[]) {
     std::ios::sync_with_stdio(false);
@@ -23,29 +27,62 @@ int main(int argc, const char* argv[]) {
         std::exit(1);
     }
 
+    // after the ROM: `--speed N` to run at N times real time, 0 for as fast
+    // as it goes, and in debug builds PC breakpoints in hex
+    double speed = 1.0;
+#ifndef NDEBUG
+    std::vector<gem::u16> breakpoints;
+#endif
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            speed = std::strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !std::isfinite(speed) ||
+                speed < 0.0) {
+                std::cerr << "--speed needs a number, 0 or more, not '"
+                          << argv[i] << "'\n";
+                std::exit(1);
+            }
+        } else {
 #ifndef NDEBUG
-    if (argc > 2) {
-        std::vector<gem::u16> breakpoints;
-        for (int i = 2; i < argc; ++i) {
             breakpoints.push_back(
                   static_cast<gem::u16>(std::strtol(argv[i], nullptr, 16)));
+#endif
         }
+    }
+#ifndef NDEBUG
+    if (!breakpoints.empty()) {
         gem::op::pcBreakpoints = {std::move(breakpoints)};
     }
 #endif
 
     gem::Window window;
     gem::Screen screen{window};
-    gem::GPU gpu{screen};
-    gem::IO io;
-    gem::Mem mem{*std::move(rom), gpu, io};
-    io.setMem(&mem);
-    gpu.setMem(&mem);
-    gem::CPU cpu{mem};
-    while (window.isOpen()) {
-        cpu.execute();
-        gpu.step(cpu.getDeltaTicks());
-        io.update(cpu.getDeltaTicks());
-        cpu.processInterrupts();
-    }
+    gem::GameBoy gameBoy{*std::move(rom), screen};
+    // drawing overlaps emulation given a core to spare
+    gameBoy.gpu.setRenderThread(std::thread::hardware_concurrency() > 1);
+    // the window shows frames at its own pace and holds nothing back, so the
+    // pacer is what keeps emulation to the speed asked for. holding Tab runs
+    // it flat out, drawing only every 4th frame. the window has to stay on
+    // the main thread, so emulation gets one of its own.
+    std::thread emulation{[&] {
+        gem::Pacer pacer{speed};
+        bool fastForward = false;
+        double shownSpeed = 0.0;
+        while (window.isOpen()) {
+            gameBoy.step();
+            if (gem::sfml::fastForwardHeld(window) != fastForward) {
+                fastForward = !fastForward;
+                pacer.setSpeed(fastForward ? gem::Pacer::Unlimited : speed);
+                gameBoy.gpu.setFrameSkip(fastForward ? 4 : 1);
+            }
+            pacer.pace(gameBoy.getTicks());
+            if (pacer.achievedSpeed() != shownSpeed) {
+                shownSpeed = pacer.achievedSpeed();
+                gem::sfml::showSpeed(window, shownSpeed);
+            }
+        }
+    }};
+    gem::sfml::show(window);
+    emulation.join();
 }
@@ -3,12 +3,21 @@
 
 #include "fwd.hpp"
 
+#include <array>
 #include <variant>
+#include <vector>
 
 namespace gem {
 
+// the registers of each kind of mapper, and how they translate into banks
 namespace MBCMode {
-struct None {};
+struct None {
+    bool write(u16, u8) { return false; }
+    usize romBank() const { return 1; }
+    bool externalRamEnabled() const { return true; }
+    usize ramBank() const { return 0; }
+    u8* rtcRegister() { return nullptr; }
+};
 struct MBC1 {
     bool ramEnabled = true;
     u8 romBankLower5 = 0x01;
@@ -17,6 +26,17 @@ struct MBC1 {
         ROM,
         RAM,
     } quuxMode = QuuxMode::ROM;
+
+    bool write(u16 address, u8 value);
+    usize romBank() const {
+        return romBankLower5 |
+               ((quux << 5) & u8((quuxMode == QuuxMode::RAM) - 1));
+    }
+    bool externalRamEnabled() const { return ramEnabled; }
+    usize ramBank() const {
+        return quux & u8((quuxMode == QuuxMode::ROM) - 1);
+    }
+    u8* rtcRegister() { return nullptr; }
 };
 struct MBC3 {
     bool ramRTCEnabled = false;
@@ -24,9 +44,23 @@ struct MBC3 {
     u8 ramOrRTC = 0x00;
     // u8 latchData = 0x00; // somewhat punting on full RTC support here
     std::array<u8, 5> rtcRegisters = {};
+
+    bool write(u16 address, u8 value);
+    usize romBank() const { return romBankLower7; }
+    bool externalRamEnabled() const { return ramRTCEnabled; }
+    usize ramBank() const { return ramOrRTC; }
+    u8* rtcRegister() {
+        return ramOrRTC >= 0x08 ? rtcRegisters.data() + (ramOrRTC - 0x08)
+                                : nullptr;
+    }
 };
 }  // namespace MBCMode
 
+// the mapper is fixed by the cartridge header, so everything that depends on
+// its kind is instantiated once per mapper and picked when the ROM is
+// loaded. writes to its registers go straight to that instantiation, which
+// works out what the banked regions map to there and then; looking memory
+// up is plain arithmetic on the result.
 struct MBC {
     enum : u16 {
         Selector = 0x0147,
@@ -36,21 +70,63 @@ struct MBC {
 
     explicit MBC(std::vector<u8> rom);
 
-    bool consumeWrite(const u16 address, const u8 val);
+    // the banks point into the MBC itself
+    MBC(const MBC&) = delete;
+    MBC& operator=(const MBC&) = delete;
+
+    bool consumeWrite(const u16 address, const u8 val) {
+        return consumeWriteFn(*this, address, val);
+    }
+
+    // whether 0xA000-0xBFFF is currently backed by plain RAM, so that it can
+    // be accessed through a pointer without asking the MBC each time
+    bool externalRamMappable() const { return externalBanked; }
 
-    const u8* ptr(const u16 address) const;
-    u8* ptr(const u16 address);
+    // which bank of ROM (0x0000-0x7FFF) or RAM (0xA000-0xBFFF) `address` maps
+    // to. only meaningful for RAM while externalRamMappable().
+    usize bank(const u16 address) const {
+        if (address <= 0x3FFF) {
+            return 0;
+        }
+        return address <= 0x7FFF ? romBank : ramBank;
+    }
+
+    const u8* ptr(const u16 address) const {
+        if (address <= 0x7FFF) {
+            return rom.data() + romOffset(address);
+        }
+        return externalRead + externalOffset(address);
+    }
+    u8* ptr(u16 address);
 
    private:
+    usize romOffset(const u16 address) const {
+        return address <= 0x3FFF ? address
+                                 : romBank * 0x4000 + (address - 0x4000);
+    }
+    usize externalOffset(const u16 address) const {
+        return externalBanked ? usize(address - 0xA000) : 0;
+    }
+
+    using ConsumeWrite = bool (*)(MBC&, u16, u8);
+    template <typename M>
+    static bool consumeWriteAs(MBC& mbc, u16 address, u8 value);
+    template <typename M>
+    void mapBanks(M& m);
+
     std::vector<u8> rom;
 
     Mode mode;
     std::vector<u8> externalRam;
 
-    bool ramEnabled() const;
-
-    template <bool>
-    struct GetPtr;
+    ConsumeWrite consumeWriteFn;
+    usize romBank = 1;
+    usize ramBank = 0;
+    // where 0xA000 maps to. unless banked, every address there maps to the
+    // same byte: an RTC register, or nothing while RAM is disabled.
+    const u8* externalRead = nullptr;
+    u8* externalWrite = nullptr;
+    bool externalBanked = false;
 };
 
 }  // namespace gem
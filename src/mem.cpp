@@ -2,6 +2,7 @@
 
 #include "bootstrap.hpp"
 
+#include "block_cache.hpp"
 #include "gpu.hpp"
 #include "io.hpp"
 
@@ -10,6 +11,12 @@
 namespace {
 constexpr std::array<gem::u8, 2> zeroData{0x00, 0x00};
 std::array<gem::u8, 2> garbage{0x00, 0x00};
+
+// echo RAM writes land in working RAM
+gem::u16 unechoed(const gem::u16 address) {
+    return 0xE000 <= address && address <= 0xFDFF ? gem::u16(address - 0x2000)
+                                                  : address;
+}
 }  // namespace
 
 namespace gem {
@@ -20,21 +27,154 @@ Mem::Mem(Block rom, GPU& gpu, IO& io)
     , bootstrap(::gem::loadBootstrapROM())
     , gpu{gpu}
     , io{io}
-    , workingRam(makeBlock<0xC000, 0xDFFF>()) {}
+    , workingRam(makeBlock<0xC000, 0xDFFF>())
+    , codeBytes() {
+    mapPages();
+    mapWriters();
+}
+
+void Mem::noteWrite(const u16 address) {
+    if ((address >= 0xFF00 && address < 0xFF80) ||
+        address == Interrupt::Registers::IE) {
+        ioWritten = true;
+    }
+    noteCodeWrite(address);
+}
+
+void Mem::noteCodeWrite(const u16 address) {
+    const u16 code = unechoed(address);
+    if (codePages[code >> 8u] && codeBytes.test(code)) {
+        invalidateCode(code >> 8u);
+    }
+}
+
+usize Mem::bankAt(const u16 address) const {
+    if (address <= 0x7FFF || (0xA000 <= address && address <= 0xBFFF)) {
+        return mbc.bank(address);
+    }
+    return 0;
+}
+
+void Mem::watchCode(const u16 first, const u16 last) {
+    GEM_ASSERT(first >> 8u == last >> 8u);
+    const usize page = first >> 8u;
+    for (usize address = first; address <= last; ++address) {
+        codeBytes.set(address);
+    }
+    if (!codePages[page]) {
+        codePages[page] = true;
+        mapPage(page);
+        if (0xC0 <= page && page <= 0xDD) {
+            mapPage(page + 0x20);
+        }
+    }
+}
+
+void Mem::invalidateCode(const usize page) {
+    codePages[page] = false;
+    for (usize address = page << 8u; address < ((page + 1) << 8u); ++address) {
+        codeBytes.reset(address);
+    }
+    if (blockCache != nullptr) {
+        blockCache->invalidatePage(page);
+    }
+    mapPage(page);
+    if (0xC0 <= page && page <= 0xDD) {
+        mapPage(page + 0x20);
+    }
+}
 
-u8 Mem::read(u16 address) const {
-    return *ptr(address);
+void Mem::mapWriters() {
+    for (usize page = 0; page < PageCount; ++page) {
+        if (page <= 0x7F) {
+            pageWriters[page] = &Mem::writeCartridge;
+        } else if (page <= 0x9F) {
+            pageWriters[page] = &Mem::writeVRAM;
+        } else if (page <= 0xBF) {
+            pageWriters[page] = &Mem::writeExternalRAM;
+        } else if (page <= 0xFD) {
+            pageWriters[page] = &Mem::writeWorkingRAM;
+        } else if (page == 0xFE) {
+            pageWriters[page] = &Mem::writeOAM;
+        } else {
+            pageWriters[page] = &Mem::writeHigh;
+        }
+    }
+    for (usize low = 0; low < 0x100; ++low) {
+        const u16 address = u16(0xFF00 + low);
+        if (IO::handlesWrite(address)) {
+            highWriters[low] = &Mem::writeIODevice;
+        } else if (GPU::handlesWrite(address)) {
+            highWriters[low] = &Mem::writeGPURegister;
+        } else if (0xFF80 <= address && address <= 0xFFFE) {
+            highWriters[low] = &Mem::writeHighRAM;
+        } else {
+            highWriters[low] = &Mem::writeIORegister;
+            highRegisters[low] = mut_ptr(address);
+        }
+    }
 }
 
-void Mem::write(u16 address, u8 value) {
-    const bool consumed = mbc.consumeWrite(address, value) ||
-                          io.consumeWrite(address, value) ||
-                          gpu.consumeWrite(address, value);
-    if (!consumed) {
-        *mut_ptr(address) = value;
+void Mem::writeCartridge(const u16 address, const u8 value) {
+    if (mbc.consumeWrite(address, value)) {
+        mapCartridgePages();
+    } else {
+        *mbc.ptr(address) = value;
     }
 }
+
+void Mem::writeVRAM(const u16 address, const u8 value) {
+    noteCodeWrite(address);
+    gpu.writeVRAM(u16(address - 0x8000), value);
+}
+
+void Mem::writeExternalRAM(const u16 address, const u8 value) {
+    noteCodeWrite(address);
+    *mbc.ptr(address) = value;
+}
+
+void Mem::writeWorkingRAM(const u16 address, const u8 value) {
+    noteCodeWrite(address);
+    workingRam[unechoed(address) - 0xC000] = value;
+}
+
+void Mem::writeOAM(const u16 address, const u8 value) {
+    if (address <= 0xFE9F) {
+        gpu.writeSpriteData(u16(address - 0xFE00), value);
+    }
+}
+
+void Mem::writeIORegister(const u16 address, const u8 value) {
+    ioWritten = true;
+    *highRegisters[address & 0xFF] = value;
+}
+
+void Mem::writeIODevice(const u16 address, const u8 value) {
+    ioWritten = true;
+    io.consumeWrite(address, value);
+}
+
+void Mem::writeGPURegister(const u16 address, const u8 value) {
+    ioWritten = true;
+    gpu.consumeWrite(address, value);
+}
+
+void Mem::writeHighRAM(const u16 address, const u8 value) {
+    noteCodeWrite(address);
+    zeroPage[address - 0xFF80] = value;
+}
 void Mem::write(const u16 address, const u16 value) {
+    // the GPU logs what's written to VRAM and OAM, so it's told byte by byte
+    const auto logged = [](const u16 a) {
+        return (0x8000 <= a && a <= 0x9FFF) || (0xFE00 <= a && a <= 0xFE9F);
+    };
+    if (logged(address) || logged(u16(address + 1))) {
+        writeSlow(address, u8(value));
+        writeSlow(u16(address + 1), u8(value >> 8u));
+        return;
+    }
+    noteWrite(address);
+    noteWrite(address + 1);
     std::memcpy(mut_ptr(address), &value, 2);
 }
 
@@ -62,7 +202,8 @@ struct GetPtr {
             case 0x8000:
             case 0x9000:
                 if constexpr (Write) {
-                    return mem.gpu.writableVramPtr(address - 0x8000);
+                    // only ever written through write(), so the GPU logs it
+                    return ::garbage.data();
                 } else {
                     return mem.gpu.vramPtr(address - 0x8000);
                 }
@@ -82,6 +223,7 @@ struct GetPtr {
             case 0xF000: {
                 switch (address & 0x0F00) {
                     // shadow working RAM
+                    case 0x0000:
                     case 0x0100:
                     case 0x0200:
                     case 0x0300:
@@ -90,6 +232,7 @@ struct GetPtr {
                     case 0x0600:
                     case 0x0700:
                     case 0x0800:
+                    case 0x0900:
                     case 0x0A00:
                     case 0x0B00:
                     case 0x0C00:
@@ -99,8 +242,8 @@ struct GetPtr {
                     case 0x0E00:
                         if (address <= 0xFE9F) {
                             if constexpr (Write) {
-                                return mem.gpu.writableSpriteDataPtr(address -
-                                                                     0xFE00);
+                                // as for VRAM
+                                return ::garbage.data();
                             } else {
                                 return mem.gpu.spriteDataPtr(address - 0xFE00);
                             }
@@ -148,10 +291,43 @@ struct GetPtr {
     }
 };
 
-const u8* Mem::ptr(u16 address) const {
+const u8* Mem::ptrSlow(const u16 address) const {
     return GetPtr<false>{}(*this, address);
 }
 
+void Mem::mapPage(const usize page) {
+    const u16 address = u16(page << 8u);
+    const bool cartridgeRam = 0xA0 <= page && page <= 0xBF;
+    const bool directRead =
+          page <= 0xFD && (!cartridgeRam || mbc.externalRamMappable());
+    const bool directWrite =
+          ((cartridgeRam && mbc.externalRamMappable()) ||
+           (0xC0 <= page && page <= 0xFD)) &&
+          !watched(page);
+    readPages[page] = directRead ? GetPtr<false>{}(*this, address) : nullptr;
+    writePages[page] = directWrite ? GetPtr<true>{}(*this, address) : nullptr;
+}
+
+bool Mem::watched(const usize page) const {
+    return codePages[page] ||
+           (0xE0 <= page && page <= 0xFD && codePages[page - 0x20]);
+}
+
+void Mem::mapPages() {
+    for (usize page = 0; page < PageCount; ++page) {
+        mapPage(page);
+    }
+}
+
+void Mem::mapCartridgePages() {
+    for (usize page = 0x40; page <= 0x7F; ++page) {
+        mapPage(page);
+    }
+    for (usize page = 0xA0; page <= 0xBF; ++page) {
+        mapPage(page);
+    }
+}
+
 u8* Mem::mut_ptr(u16 address) {
     return GetPtr<true>{}(*this, address);
 }
@@ -6,10 +6,14 @@
 #include "interrupt.hpp"
 #include "mbc.hpp"
 
+#include <array>
+#include <bitset>
+#include <utility>
 #include <vector>
 
 namespace gem {
 
+struct BlockCache;
 struct GPU;
 struct IO;
 
@@ -22,11 +26,40 @@ struct Mem {
 
     explicit Mem(Block rom, GPU& gpu, IO& io);
 
-    u8 read(u16 address) const;
-    void write(u16 address, u8 value);
+    Mem(const Mem&) = delete;
+    Mem& operator=(const Mem&) = delete;
+
+    u8 read(const u16 address) const { return *ptr(address); }
+    void write(const u16 address, const u8 value) {
+        if (u8* const page = writePages[address >> 8u]) {
+            page[address & 0xFF] = value;
+        } else {
+            writeSlow(address, value);
+        }
+    }
     void write(u16 address, u16 value);
 
-    const u8* ptr(u16 address) const;
+    const u8* ptr(const u16 address) const {
+        if (const u8* const page = readPages[address >> 8u]) {
+            return page + (address & 0xFF);
+        }
+        return ptrSlow(address);
+    }
+
+    // whether anything was written to an IO register (or IE) since the last
+    // call. the CPU uses this to hand control back to the devices.
+    bool consumeIOWrite() { return std::exchange(ioWritten, false); }
+    bool ioWritePending() const { return ioWritten; }
+
+    // the host memory a page maps to, if it can be read without side effects
+    const u8* readPage(const usize page) const { return readPages[page]; }
+    // the ROM or cartridge RAM bank mapped at `address`, 0 elsewhere
+    usize bankAt(u16 address) const;
+
+    // code in RAM that the block cache has decoded. writes to those bytes
+    // take the slow path and invalidate the cached blocks of their page.
+    void setBlockCache(BlockCache* const cache) { blockCache = cache; }
+    void watchCode(u16 first, u16 last);
 
     template <std::size_t Start, std::size_t EndInclusive>
     static Block makeBlock(Block block = {}) {
@@ -43,7 +76,43 @@ struct Mem {
    private:
     template <bool>
     friend struct GetPtr;
+    friend struct JIT;
     u8* mut_ptr(u16 address);
+    const u8* ptrSlow(u16 address) const;
+    void writeSlow(u16 address, u8 value) {
+        (this->*pageWriters[address >> 8u])(address, value);
+    }
+    void noteWrite(u16 address);
+    void noteCodeWrite(u16 address);
+
+    // what a write to a page that isn't mapped straight to memory does,
+    // and for 0xFF00-0xFFFF, to each address. every side effect has a
+    // handler of its own, so a write runs exactly one of them.
+    using Writer = void (Mem::*)(u16 address, u8 value);
+    void mapWriters();
+    void writeCartridge(u16 address, u8 value);
+    void writeVRAM(u16 address, u8 value);
+    void writeExternalRAM(u16 address, u8 value);
+    void writeWorkingRAM(u16 address, u8 value);
+    void writeOAM(u16 address, u8 value);
+    void writeHigh(u16 address, u8 value) {
+        (this->*highWriters[address & 0xFF])(address, value);
+    }
+    void writeIORegister(u16 address, u8 value);
+    void writeIODevice(u16 address, u8 value);
+    void writeGPURegister(u16 address, u8 value);
+    void writeHighRAM(u16 address, u8 value);
+
+    // every 256-byte page that can be accessed without side effects maps
+    // straight to host memory. pages that need a handler (IO registers, OAM,
+    // writes to ROM or VRAM, disabled or RTC-mapped cartridge RAM) are null
+    // and go through GetPtr instead.
+    static constexpr usize PageCount = 0x100;
+    void mapPages();
+    void mapCartridgePages();
+    void mapPage(usize page);
+    bool watched(usize page) const;
+    void invalidateCode(usize page);
 
     MBC mbc;
 
@@ -52,6 +121,19 @@ struct Mem {
     GPU& gpu;
     IO& io;
     Block workingRam;
+
+    std::array<const u8*, PageCount> readPages = {};
+    std::array<u8*, PageCount> writePages = {};
+    std::array<Writer, PageCount> pageWriters = {};
+    std::array<Writer, 0x100> highWriters = {};
+    // where writeIORegister() stores each of 0xFF00-0xFFFF
+    std::array<u8*, 0x100> highRegisters = {};
+
+    bool ioWritten = false;
+
+    BlockCache* blockCache = nullptr;
+    std::array<bool, PageCount> codePages = {};
+    std::bitset<0x10000> codeBytes;
 };
 
 }  // namespace gem
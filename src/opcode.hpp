@@ -3,6 +3,9 @@
 
 #include "fwd.hpp"
 
+#include <array>
+#include <vector>
+
 namespace gem {
 
 struct CPU;
@@ -11,6 +14,109 @@ namespace op {
 // this implementation is generated
 DeltaTicks runOpcode(u8 opcode, CPU& cpu);
 
+// runs an already decoded instruction, given its immediate operand (if any).
+// PC must already point past the instruction.
+using ExecFn = DeltaTicks (*)(CPU& cpu, u16 operand);
+
+// the memory an instruction reads, apart from its own bytes
+enum class Reads : u8 {
+    Nothing,
+    BC,
+    DE,
+    HL,
+    Operand,      // (nn)
+    HighC,        // (0xFF00 + C)
+    HighOperand,  // (0xFF00 + n)
+    Stack,        // (SP) and (SP + 1)
+};
+
+// what an instruction does, for the JIT to do it in host code, worked out
+// by gen_opcodes.py from its implementation. Kind::Call for anything else,
+// which the JIT runs through exec.
+struct Native {
+    enum class Kind : u8 {
+        Call,
+        Nop,
+        Load,    // dst = src, 8 bits
+        Load16,  // dst = the operand
+        Add,     // A op= src, setting the flags
+        Sub,
+        And,
+        Or,
+        Xor,
+        Cp,  // the flags of A - src
+        Inc,  // dst += 1, setting the flags but C
+        Dec,
+        Inc16,
+        Dec16,
+        Jump,  // PC = src if the condition holds
+    };
+    enum class Loc : u8 {
+        None,
+        A,
+        B,
+        C,
+        D,
+        E,
+        H,
+        L,
+        BC,
+        DE,
+        HL,
+        SP,
+        Operand,
+        Relative,  // PC plus the operand, signed
+        AtBC,      // memory at...
+        AtDE,
+        AtHL,
+        AtOperand,
+        AtHighC,        // 0xFF00 + C
+        AtHighOperand,  // 0xFF00 + n
+    };
+    enum class Condition : u8 { Always, Z, NZ, C, NC };
+
+    Kind kind = Kind::Call;
+    Loc dst = Loc::None;
+    Loc src = Loc::None;
+    Condition condition = Condition::Always;
+    i8 hlStep = 0;  // LDI and LDD add this to HL after the access
+    u8 ticks = 0;   // without a taken branch
+};
+
+struct DecodeInfo {
+    ExecFn exec;  // null if unimplemented
+    u8 operandBytes;
+    u8 maxTicks;  // including a taken branch
+    bool endsBlock;
+    // only touches registers: no memory writes, pushes or interrupt changes
+    bool pure;
+    Reads reads;
+    Native native;
+};
+
+// indexed by opcode, and by the second byte for 0xCB-prefixed opcodes. also
+// generated.
+extern const std::array<DecodeInfo, 256> decodeTable;
+extern const std::array<DecodeInfo, 256> decodeTable_0xCB;
+
+// a run of instructions fused into one handler, so that the block cache
+// dispatches once for all of them. the handler takes the parts' operands
+// packed low byte first. generated from the profile passed to
+// `gen_opcodes.py --fuse`.
+struct Fusion {
+    std::array<ExecFn, 3> parts;  // null after the last one
+    std::array<u8, 3> operandBytes;
+    ExecFn exec;
+};
+extern const std::vector<Fusion> fusions;
+
+#if GEM_THREADED_DISPATCH
+// CPU::run with threaded dispatch: every opcode handler retires its
+// instruction and jumps straight to the handler for the next one. also
+// generated, by `gen_opcodes.py --threaded`.
+DeltaTicks runThreaded(CPU& cpu, Ticks budget);
+#endif
+
 #if GEM_DEBUG_LOGGING
 void enableVerbosePrinting();
 void disableVerbosePrinting();
@@ -0,0 +1,73 @@
+#include "pacer.hpp"
+
+#include <thread>
+
+namespace gem {
+
+namespace {
+using Clock = std::chrono::steady_clock;
+using namespace std::chrono_literals;
+
+// sleeps can overrun by this much, so the rest is waited out by yielding
+constexpr auto SpinTime = 1ms;
+// further behind than this, the host doesn't try to catch up: emulation
+// carries on at the set speed from where it is
+constexpr auto MaxLag = 100ms;
+
+void sleepUntil(const Clock::time_point when) {
+    if (when - Clock::now() > SpinTime) {
+        std::this_thread::sleep_until(when - SpinTime);
+    }
+    while (Clock::now() < when) {
+        std::this_thread::yield();
+    }
+}
+}  // namespace
+
+void Pacer::setSpeed(const double speed) {
+    multiplier = speed;
+    restart = true;
+    nextCheck = 0;
+}
+
+void Pacer::wait(const Ticks now) {
+    nextCheck = now + FrameTicks;
+    const Clock::time_point host = Clock::now();
+    measure(host, now);
+    if (restart) {
+        restart = false;
+        start = host;
+        startTicks = now;
+        return;
+    }
+    if (multiplier == Unlimited) {
+        return;
+    }
+    const std::chrono::duration<double> emulated{
+          double(now - startTicks) / (double(TicksPerSecond) * multiplier)};
+    const Clock::time_point due =
+          start + std::chrono::duration_cast<Clock::duration>(emulated);
+    if (host - due > MaxLag) {
+        start = host;
+        startTicks = now;
+        return;
+    }
+    sleepUntil(due);
+}
+
+void Pacer::measure(const Clock::time_point host, const Ticks now) {
+    if (measuredFrom == Clock::time_point{}) {
+        measuredFrom = host;
+        measuredFromTicks = now;
+        return;
+    }
+    const std::chrono::duration<double> elapsed = host - measuredFrom;
+    if (elapsed >= 1s) {
+        achieved = double(now - measuredFromTicks) / double(TicksPerSecond) /
+                   elapsed.count();
+        measuredFrom = host;
+        measuredFromTicks = now;
+    }
+}
+
+}  // namespace gem
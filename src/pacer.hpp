@@ -0,0 +1,60 @@
+#ifndef GEM_PACER_HPP
+#define GEM_PACER_HPP
+
+#include "fwd.hpp"
+
+#include <chrono>
+
+namespace gem {
+
+// keeps emulation to a multiple of the DMG's own speed by holding the
+// emulated clock against the host's, and measures the speed it actually
+// gets
+struct Pacer {
+    static constexpr Ticks TicksPerSecond = 4194304;
+    // 154 lines of 456 ticks: 59.73 frames a second
+    static constexpr Ticks FrameTicks = 70224;
+    // as fast as the host goes
+    static constexpr double Unlimited = 0.0;
+
+    // `speed` as for setSpeed()
+    explicit Pacer(double speed = 1.0) : multiplier{speed} {}
+
+    // 1 is real time, 2 twice as fast and so on. the reckoning starts over
+    // from the next call to pace().
+    void setSpeed(double speed);
+    double speed() const { return multiplier; }
+
+    // waits until the host has caught up with `now` on the emulated clock.
+    // cheap enough to call after every step: it only looks at the host
+    // clock once per emulated frame.
+    void pace(const Ticks now) {
+        if (now >= nextCheck) {
+            wait(now);
+        }
+    }
+
+    // how fast emulation ran over about the last second of host time, as a
+    // multiple of the DMG's speed. 0 until a second has gone by.
+    double achievedSpeed() const { return achieved; }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+    void wait(Ticks now);
+    void measure(Clock::time_point host, Ticks now);
+
+    double multiplier;
+    bool restart = true;
+    Ticks nextCheck = 0;
+    // when emulation is due to reach any tick follows from these
+    Clock::time_point start = {};
+    Ticks startTicks = 0;
+
+    Clock::time_point measuredFrom = {};
+    Ticks measuredFromTicks = 0;
+    double achieved = 0.0;
+};
+
+}  // namespace gem
+
+#endif
@@ -0,0 +1,287 @@
+#include "pixels.hpp"
+
+#include <cstring>
+
+#if GEM_GCC_CLANG && defined(__x86_64__)
+#define GEM_X86_SIMD true
+#include <immintrin.h>
+#else
+#define GEM_X86_SIMD false
+#endif
+
+namespace gem {
+namespace pixels {
+
+namespace {
+
+template <unsigned Bytes>
+void lookupScalar(const u8* const indices,
+                  const usize count,
+                  const u8* const table,
+                  u8* const out) {
+    for (usize i = 0; i < count; ++i) {
+        std::memcpy(out + i * Bytes, table + indices[i] * Bytes, Bytes);
+    }
+}
+
+#if GEM_X86_SIMD
+// no byte shuffles: compares every lane with each of the 16 indices in turn,
+// with the indices first widened to the size of an entry
+template <unsigned Bytes>
+__attribute__((target("sse2"))) void lookupSSE2(const u8* const indices,
+                                                const usize count,
+                                                const u8* const table,
+                                                u8* out) {
+    __m128i values[16];
+    __m128i entries[16];
+    for (unsigned v = 0; v < 16; ++v) {
+        u32 entry = 0;
+        std::memcpy(&entry, table + v * Bytes, Bytes);
+        if constexpr (Bytes == 1) {
+            values[v] = _mm_set1_epi8(char(v));
+            entries[v] = _mm_set1_epi8(char(entry));
+        } else if constexpr (Bytes == 2) {
+            values[v] = _mm_set1_epi16(short(v));
+            entries[v] = _mm_set1_epi16(short(entry));
+        } else {
+            values[v] = _mm_set1_epi32(int(v));
+            entries[v] = _mm_set1_epi32(int(entry));
+        }
+    }
+    const __m128i zero = _mm_setzero_si128();
+    for (usize i = 0; i < count; i += 16) {
+        const __m128i bytes =
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+        __m128i lanes[Bytes];
+        if constexpr (Bytes == 1) {
+            lanes[0] = bytes;
+        } else {
+            const __m128i words[2] = {_mm_unpacklo_epi8(bytes, zero),
+                                      _mm_unpackhi_epi8(bytes, zero)};
+            if constexpr (Bytes == 2) {
+                lanes[0] = words[0];
+                lanes[1] = words[1];
+            } else {
+                for (unsigned w = 0; w < 2; ++w) {
+                    lanes[w * 2] = _mm_unpacklo_epi16(words[w], zero);
+                    lanes[w * 2 + 1] = _mm_unpackhi_epi16(words[w], zero);
+                }
+            }
+        }
+        for (const __m128i& lane : lanes) {
+            __m128i looked = _mm_setzero_si128();
+            for (unsigned v = 0; v < 16; ++v) {
+                __m128i hit;
+                if constexpr (Bytes == 1) {
+                    hit = _mm_cmpeq_epi8(lane, values[v]);
+                } else if constexpr (Bytes == 2) {
+                    hit = _mm_cmpeq_epi16(lane, values[v]);
+                } else {
+                    hit = _mm_cmpeq_epi32(lane, values[v]);
+                }
+                looked = _mm_or_si128(looked, _mm_and_si128(hit, entries[v]));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), looked);
+            out += 16;
+        }
+    }
+}
+
+// the table split into planes, the first byte of every entry, then the
+// second and so on. each is exactly 16 bytes, so it fits in one register and
+// pshufb can look all 16 indices up in it at once.
+template <unsigned Bytes>
+std::array<u8, 16 * Bytes> planes(const u8* const table) {
+    std::array<u8, 16 * Bytes> ret;
+    for (unsigned v = 0; v < 16; ++v) {
+        for (unsigned k = 0; k < Bytes; ++k) {
+            ret[k * 16 + v] = table[v * Bytes + k];
+        }
+    }
+    return ret;
+}
+
+template <unsigned Bytes>
+__attribute__((target("ssse3"))) void lookupSSSE3(const u8* const indices,
+                                                  const usize count,
+                                                  const u8* const table,
+                                                  u8* out) {
+    const auto split = planes<Bytes>(table);
+    __m128i plane[Bytes];
+    for (unsigned k = 0; k < Bytes; ++k) {
+        plane[k] = _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(split.data() + k * 16));
+    }
+    for (usize i = 0; i < count; i += 16) {
+        const __m128i index =
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+        __m128i l[Bytes];
+        for (unsigned k = 0; k < Bytes; ++k) {
+            l[k] = _mm_shuffle_epi8(plane[k], index);
+        }
+        // interleave the planes back into whole entries
+        __m128i* const dest = reinterpret_cast<__m128i*>(out);
+        if constexpr (Bytes == 1) {
+            _mm_storeu_si128(dest, l[0]);
+        } else if constexpr (Bytes == 2) {
+            _mm_storeu_si128(dest, _mm_unpacklo_epi8(l[0], l[1]));
+            _mm_storeu_si128(dest + 1, _mm_unpackhi_epi8(l[0], l[1]));
+        } else {
+            const __m128i lo01 = _mm_unpacklo_epi8(l[0], l[1]);
+            const __m128i hi01 = _mm_unpackhi_epi8(l[0], l[1]);
+            const __m128i lo23 = _mm_unpacklo_epi8(l[2], l[3]);
+            const __m128i hi23 = _mm_unpackhi_epi8(l[2], l[3]);
+            _mm_storeu_si128(dest, _mm_unpacklo_epi16(lo01, lo23));
+            _mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(lo01, lo23));
+            _mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(hi01, hi23));
+            _mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(hi01, hi23));
+        }
+        out += 16 * Bytes;
+    }
+}
+
+// the same 32 indices at a time. the shuffles and unpacks work within each
+// 128-bit half, so the planes are in both and the halves of the interleaved
+// results are put back in order at the end.
+template <unsigned Bytes>
+__attribute__((target("avx2"))) void lookupAVX2(const u8* const indices,
+                                                const usize count,
+                                                const u8* const table,
+                                                u8* out) {
+    const auto split = planes<Bytes>(table);
+    __m256i plane[Bytes];
+    for (unsigned k = 0; k < Bytes; ++k) {
+        plane[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(split.data() + k * 16)));
+    }
+    for (usize i = 0; i < count; i += 32) {
+        const __m256i index = _mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(indices + i));
+        __m256i l[Bytes];
+        for (unsigned k = 0; k < Bytes; ++k) {
+            l[k] = _mm256_shuffle_epi8(plane[k], index);
+        }
+        __m256i* const dest = reinterpret_cast<__m256i*>(out);
+        if constexpr (Bytes == 1) {
+            _mm256_storeu_si256(dest, l[0]);
+        } else if constexpr (Bytes == 2) {
+            const __m256i lo = _mm256_unpacklo_epi8(l[0], l[1]);
+            const __m256i hi = _mm256_unpackhi_epi8(l[0], l[1]);
+            _mm256_storeu_si256(dest, _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(dest + 1,
+                                _mm256_permute2x128_si256(lo, hi, 0x31));
+        } else {
+            const __m256i lo01 = _mm256_unpacklo_epi8(l[0], l[1]);
+            const __m256i hi01 = _mm256_unpackhi_epi8(l[0], l[1]);
+            const __m256i lo23 = _mm256_unpacklo_epi8(l[2], l[3]);
+            const __m256i hi23 = _mm256_unpackhi_epi8(l[2], l[3]);
+            const __m256i a = _mm256_unpacklo_epi16(lo01, lo23);
+            const __m256i b = _mm256_unpackhi_epi16(lo01, lo23);
+            const __m256i c = _mm256_unpacklo_epi16(hi01, hi23);
+            const __m256i d = _mm256_unpackhi_epi16(hi01, hi23);
+            _mm256_storeu_si256(dest, _mm256_permute2x128_si256(a, b, 0x20));
+            _mm256_storeu_si256(dest + 1,
+                                _mm256_permute2x128_si256(c, d, 0x20));
+            _mm256_storeu_si256(dest + 2,
+                                _mm256_permute2x128_si256(a, b, 0x31));
+            _mm256_storeu_si256(dest + 3,
+                                _mm256_permute2x128_si256(c, d, 0x31));
+        }
+        out += 32 * Bytes;
+    }
+}
+#endif
+
+using LookupFn = void (*)(const u8*, usize, const u8*, u8*);
+
+// indexed by bytes / 2: 1, 2 and 4 byte entries
+using LookupFns = std::array<LookupFn, 3>;
+
+LookupFns lookupFns(const SIMD simd) {
+    switch (simd) {
+        case SIMD::Scalar:
+            return {&lookupScalar<1>, &lookupScalar<2>, &lookupScalar<4>};
+#if GEM_X86_SIMD
+        case SIMD::SSE2:
+            return {&lookupSSE2<1>, &lookupSSE2<2>, &lookupSSE2<4>};
+        case SIMD::SSSE3:
+            return {&lookupSSSE3<1>, &lookupSSSE3<2>, &lookupSSSE3<4>};
+        case SIMD::AVX2:
+            return {&lookupAVX2<1>, &lookupAVX2<2>, &lookupAVX2<4>};
+#else
+        default:
+            break;
+#endif
+    }
+    GEM_UNREACHABLE();
+}
+
+SIMD selected = best();
+LookupFns selectedLookup = lookupFns(selected);
+
+}  // namespace
+
+bool supported(const SIMD simd) {
+#if GEM_X86_SIMD
+    // this may run before the constructor that would otherwise do it
+    __builtin_cpu_init();
+    switch (simd) {
+        case SIMD::Scalar:
+        case SIMD::SSE2:
+            return true;
+        case SIMD::SSSE3:
+            return __builtin_cpu_supports("ssse3");
+        case SIMD::AVX2:
+            return __builtin_cpu_supports("avx2");
+    }
+    GEM_UNREACHABLE();
+#else
+    return simd == SIMD::Scalar;
+#endif
+}
+
+SIMD best() {
+    for (const SIMD simd : {SIMD::AVX2, SIMD::SSSE3, SIMD::SSE2}) {
+        if (supported(simd)) {
+            return simd;
+        }
+    }
+    return SIMD::Scalar;
+}
+
+void use(const SIMD simd) {
+    GEM_ASSERT(supported(simd));
+    selected = simd;
+    selectedLookup = lookupFns(simd);
+}
+
+SIMD current() {
+    return selected;
+}
+
+const char* name(const SIMD simd) {
+    switch (simd) {
+        case SIMD::Scalar:
+            return "scalar";
+        case SIMD::SSE2:
+            return "sse2";
+        case SIMD::SSSE3:
+            return "ssse3";
+        case SIMD::AVX2:
+            return "avx2";
+    }
+    GEM_UNREACHABLE();
+}
+
+void lookup(const u8* const indices,
+            const usize count,
+            const u8* const table,
+            const unsigned bytes,
+            u8* const out) {
+    GEM_ASSERT(bytes == 1 || bytes == 2 || bytes == 4);
+    GEM_ASSERT(count % 32 == 0);
+    selectedLookup[bytes / 2](indices, count, table, out);
+}
+
+}  // namespace pixels
+}  // namespace gem
@@ -0,0 +1,57 @@
+#ifndef GEM_PIXELS_HPP
+#define GEM_PIXELS_HPP
+
+#include "fwd.hpp"
+
+#include <array>
+
+namespace gem {
+namespace pixels {
+
+// one row of a tile as stored in VRAM: the low and high bitplanes of its
+// eight pixels, leftmost pixel in the top bit
+struct TileRow {
+    u8 low;
+    u8 high;
+};
+
+// the same row decoded, a byte per pixel holding its colour code, leftmost
+// first
+using Row = std::array<u8, 8>;
+
+inline Row decode(const TileRow row, const bool xFlip = false) {
+    Row ret;
+    for (unsigned i = 0; i < 8; ++i) {
+        const unsigned bit = xFlip ? i : 7 - i;
+        ret[i] = u8(((row.low >> bit) & 1u) | (((row.high >> bit) & 1u) << 1u));
+    }
+    return ret;
+}
+
+// which instructions lookup() uses. everything but Scalar is x86-64 only, and
+// only offered when the CPU has it.
+enum class SIMD : u8 { Scalar, SSE2, SSSE3, AVX2 };
+
+// the best the host supports
+SIMD best();
+// whether `simd` runs on this host
+bool supported(SIMD simd);
+// switches every later lookup() to `simd`, which must be supported
+void use(SIMD simd);
+SIMD current();
+const char* name(SIMD simd);
+
+// replaces each of `count` bytes at `indices`, all below 16, with its entry
+// in `table`, and writes them out in order. `table` has 16 entries of
+// `bytes` bytes each, where `bytes` is 1, 2 or 4. `count` must be a multiple
+// of 32.
+void lookup(const u8* indices,
+            usize count,
+            const u8* table,
+            unsigned bytes,
+            u8* out);
+
+}  // namespace pixels
+}  // namespace gem
+
+#endif
@@ -0,0 +1,196 @@
+#include "profiler.hpp"
+
+#if GEM_PROFILE
+
+#include "cpu.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace gem {
+
+namespace {
+constexpr u8 PrefixCB = 0xCB;
+
+std::string frameName(const u32 function) {
+    std::ostringstream out;
+    out << hexString(u8(function >> 16u)) << ':' << hexString(u16(function));
+    return out.str();
+}
+
+std::string opcodeName(const usize index) {
+    if (index < 0x100) {
+        return std::string{"0x"} + hexString(u8(index)).data();
+    }
+    return std::string{"0xCB"} + hexString(u8(index)).data();
+}
+
+template <typename Key, typename Map>
+std::vector<std::pair<Key, Ticks>> mostTicks(const Map& counts,
+                                             const usize top) {
+    std::vector<std::pair<Key, Ticks>> sorted;
+    for (const auto& [key, c] : counts) {
+        if (c.count != 0) {
+            sorted.emplace_back(key, c.ticks);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    sorted.resize(std::min(sorted.size(), top));
+    return sorted;
+}
+}  // namespace
+
+Profiler::Profiler(const CPU& cpu) : cpu{cpu} {
+    prepare();
+    nodes.push_back(Node{nextLocation, 0});
+}
+
+void Profiler::record(void* const context, const CPU& cpu) {
+    auto& profiler = *static_cast<Profiler*>(context);
+    GEM_ASSERT(&profiler.cpu == &cpu);
+    (void)cpu;
+    profiler.instruction();
+}
+
+void Profiler::instruction() {
+    const DeltaTicks ticks = cpu.getDeltaTicks();
+    const usize current = stack.empty() ? 0 : stack.back().node;
+    if (!running) {
+        nodes[child(current, Halted)].ticks += ticks;
+        prepare();
+        return;
+    }
+
+    auto& op = opcodes[nextOpcode < 0x100 ? nextOpcode
+                                          : 0x100 + (nextOpcode & 0xFF)];
+    ++op.count;
+    op.ticks += ticks;
+    auto& location = locations[nextLocation];
+    ++location.count;
+    location.ticks += ticks;
+    nodes[current].ticks += ticks;
+
+    // CALL and RST push and jump; PUSH is a single byte that falls through.
+    // the same goes for RET and RETI against POP.
+    const u16 pc = cpu.reg.getPC();
+    const u16 sp = cpu.reg.getSP();
+    if (didPush && pc != u16(nextPC + 1)) {
+        call(this->location(pc), sp);
+    } else if (didPop && pc != u16(nextPC + 1)) {
+        // also drops the frames of anything that never returned
+        while (!stack.empty() && stack.back().sp < sp) {
+            stack.pop_back();
+        }
+    }
+    prepare();
+}
+
+void Profiler::interrupted(const u16 handler) {
+    // the push was the interrupt's, not the next instruction's
+    didPush = false;
+    running = true;
+    call(location(handler), cpu.reg.getSP());
+    prepare();
+}
+
+u32 Profiler::location(const u16 address) const {
+    return u32(cpu.bus.bankAt(address) << 16u) | address;
+}
+
+void Profiler::call(const u32 function, const u16 sp) {
+    if (stack.size() >= MaxDepth) {
+        return;
+    }
+    const usize current = stack.empty() ? 0 : stack.back().node;
+    stack.push_back(Frame{child(current, function), sp});
+}
+
+usize Profiler::child(const usize parent, const u32 function) {
+    const auto it = nodes[parent].children.find(function);
+    if (it != nodes[parent].children.end()) {
+        return it->second;
+    }
+    // push_back may move the parent
+    const usize index = nodes.size();
+    nodes.push_back(Node{function, parent});
+    nodes[parent].children.emplace(function, index);
+    return index;
+}
+
+void Profiler::prepare() {
+    nextPC = cpu.reg.getPC();
+    nextLocation = location(nextPC);
+    nextOpcode = cpu.bus.read(nextPC);
+    if (nextOpcode == PrefixCB) {
+        nextOpcode = u16((nextOpcode << 8u) | cpu.bus.read(u16(nextPC + 1)));
+    }
+    running = cpu.isRunning();
+    didPush = false;
+    didPop = false;
+}
+
+std::string Profiler::collapsedStacks() const {
+    std::string path;
+    std::string out;
+    collapse(0, path, out);
+    return out;
+}
+
+void Profiler::collapse(const usize index,
+                        std::string& path,
+                        std::string& out) const {
+    const Node& node = nodes[index];
+    const usize length = path.size();
+    if (!path.empty()) {
+        path += ';';
+    }
+    path += node.function == Halted ? "(halted)" : frameName(node.function);
+    if (node.ticks != 0) {
+        out += path;
+        out += ' ';
+        out += std::to_string(node.ticks);
+        out += '\n';
+    }
+    for (const auto& [function, child] : node.children) {
+        collapse(child, path, out);
+    }
+    path.resize(length);
+}
+
+std::string Profiler::report(const usize top) const {
+    Ticks total = 0;
+    for (const Node& node : nodes) {
+        total += node.ticks;
+    }
+    const auto percent = [&](const Ticks ticks) {
+        return total == 0 ? 0.0 : 100.0 * double(ticks) / double(total);
+    };
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "ticks: " << total << '\n';
+    out << "\nopcode      count       ticks      %\n";
+    std::vector<std::pair<usize, Counts>> indexed;
+    for (usize i = 0; i < opcodes.size(); ++i) {
+        indexed.emplace_back(i, opcodes[i]);
+    }
+    for (const auto& [index, ticks] : mostTicks<usize>(indexed, top)) {
+        out << std::left << std::setw(8) << opcodeName(index) << std::right
+            << std::setw(9) << opcodes[index].count << std::setw(12) << ticks
+            << std::setw(7) << percent(ticks) << '\n';
+    }
+    out << "\nbank:PC     count       ticks      %\n";
+    for (const auto& [loc, ticks] : mostTicks<u32>(locations, top)) {
+        out << std::left << std::setw(8) << frameName(loc) << std::right
+            << std::setw(9) << locations.at(loc).count << std::setw(12)
+            << ticks << std::setw(7) << percent(ticks) << '\n';
+    }
+    return out.str();
+}
+
+}  // namespace gem
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef GEM_PROFILER_HPP
+#define GEM_PROFILER_HPP
+
+#include "fwd.hpp"
+
+#if GEM_PROFILE
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gem {
+
+struct CPU;
+
+// counts the instructions that run and the ticks they take, per opcode, per
+// (ROM bank, PC) and per call stack. it runs as the CPU's instruction hook,
+// so everything is seen one instruction at a time; calls and returns are
+// told apart from PUSH and POP by the stack notifications the CPU sends when
+// built with GEM_PROFILE.
+struct Profiler {
+    explicit Profiler(const CPU& cpu);
+
+    // install with CPU::setProfiler()
+    static void record(void* context, const CPU& cpu);
+
+    void pushed() { didPush = true; }
+    void popped() { didPop = true; }
+    // a halted or stopped CPU was woken up by a pending interrupt
+    void woke() { running = true; }
+    void interrupted(u16 handler);
+
+    // one line per call stack: `frame;frame;frame ticks`, the format
+    // flamegraph.pl and friends read
+    std::string collapsedStacks() const;
+    // the `top` most expensive opcodes and PCs
+    std::string report(usize top) const;
+
+   private:
+    struct Counts {
+        unsigned long long count = 0;
+        Ticks ticks = 0;
+    };
+
+    struct Node {
+        u32 function;  // (bank << 16) | address
+        usize parent;
+        Ticks ticks = 0;
+        std::unordered_map<u32, usize> children = {};
+    };
+
+    struct Frame {
+        usize node;
+        u16 sp;  // where the return address is
+    };
+
+    void instruction();
+    u32 location(u16 address) const;
+    void call(u32 function, u16 sp);
+    usize child(usize parent, u32 function);
+    void prepare();
+    void collapse(usize node, std::string& path, std::string& out) const;
+
+    static constexpr u32 Halted = 0xFFFF'FFFF;
+    // games that call without ever returning would grow it forever
+    static constexpr usize MaxDepth = 64;
+
+    const CPU& cpu;
+
+    // the instruction about to run
+    u16 nextPC = 0;
+    u32 nextLocation = 0;
+    u16 nextOpcode = 0;
+    bool running = true;
+    bool didPush = false;
+    bool didPop = false;
+
+    // single-byte opcodes, then the 0xCB page
+    std::array<Counts, 0x200> opcodes = {};
+    std::unordered_map<u32, Counts> locations = {};
+
+    std::vector<Node> nodes = {};
+    std::vector<Frame> stack = {};
+};
+
+}  // namespace gem
+
+#endif
+
+#endif
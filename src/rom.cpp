@@ -3,6 +3,7 @@
 
 #include <fstream>
 #include <optional>
+#include <string>
 #include <vector>
 
 std::optional<gem::Mem::Block> gem::ROM::load(
@@ -15,3 +16,14 @@ std::optional<gem::Mem::Block> gem::ROM::load(
     return gem::Mem::Block(std::istreambuf_iterator<char>{fstr},
                            std::istreambuf_iterator<char>{});
 }
+
+std::string gem::ROM::title(const gem::Mem::Block& rom) {
+    constexpr gem::usize First = 0x134;
+    constexpr gem::usize Last = 0x143;
+    std::string ret;
+    for (gem::usize i = First; i <= Last && i < rom.size() && rom[i] != 0;
+         ++i) {
+        ret.push_back(char(rom[i]));
+    }
+    return ret;
+}
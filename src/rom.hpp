@@ -5,11 +5,14 @@
 #include "fwd.hpp"
 #include "mem.hpp"
 
+#include <string>
 #include <vector>
 
 namespace gem {
 namespace ROM {
 std::optional<Mem::Block> load(const fs::AbsolutePath& path);
+// the game's name from the cartridge header
+std::string title(const Mem::Block& rom);
 }
 }  // namespace gem
 
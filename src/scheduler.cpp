@@ -0,0 +1,48 @@
+#include "scheduler.hpp"
+
+#include <limits>
+
+namespace gem {
+
+void Scheduler::schedule(const Event event, const Ticks when) {
+    cancel(event);
+    usize pos = count;
+    while (pos > 0 && entries[pos - 1].when > when) {
+        entries[pos] = entries[pos - 1];
+        --pos;
+    }
+    entries[pos] = Entry{when, event};
+    ++count;
+}
+
+void Scheduler::cancel(const Event event) {
+    const auto end = entries.begin() + count;
+    const auto it = std::find_if(entries.begin(), end, [&](const Entry& e) {
+        return e.event == event;
+    });
+    if (it != end) {
+        std::copy(it + 1, end, it);
+        --count;
+    }
+}
+
+Ticks Scheduler::nextEventTime() const {
+    return count != 0 ? entries[0].when : std::numeric_limits<Ticks>::max();
+}
+
+std::optional<Scheduler::Entry> Scheduler::popDue() {
+    if (count == 0 || entries[0].when > now()) {
+        return std::nullopt;
+    }
+    return pop();
+}
+
+Scheduler::Entry Scheduler::pop() {
+    GEM_ASSERT(count != 0);
+    const Entry first = entries[0];
+    std::copy(entries.begin() + 1, entries.begin() + count, entries.begin());
+    --count;
+    return first;
+}
+
+}  // namespace gem
@@ -0,0 +1,54 @@
+#ifndef GEM_SCHEDULER_HPP
+#define GEM_SCHEDULER_HPP
+
+#include "fwd.hpp"
+
+#include <array>
+#include <functional>
+#include <optional>
+
+namespace gem {
+
+// a timestamp-ordered queue of device events, keyed off the CPU's tick
+// counter. every kind of event is pending at most once, so the queue is just
+// a tiny sorted array.
+struct Scheduler {
+    enum class Event : u8 {
+        PPU,   // mode change or LY increment
+        DIV,   // DIV increment
+        TIMA,  // TIMA increment
+        Count,
+    };
+
+    struct Entry {
+        Ticks when;
+        Event event;
+    };
+
+    explicit Scheduler(const Ticks& clock) : clock{clock} {}
+
+    Ticks now() const { return clock.get(); }
+
+    // replaces any pending occurrence of the same event
+    void schedule(Event event, Ticks when);
+    void cancel(Event event);
+
+    Ticks nextEventTime() const;
+
+    // removes and returns the earliest event if it's due
+    std::optional<Entry> popDue();
+
+    // the earliest event whether or not it's due, null if there is none
+    const Entry* peek() const { return count != 0 ? &entries[0] : nullptr; }
+    // removes and returns the earliest event whether or not it's due
+    Entry pop();
+
+   private:
+    std::reference_wrapper<const Ticks> clock;
+    std::array<Entry, idx(Event::Count)> entries = {};
+    usize count = 0;
+};
+
+}  // namespace gem
+
+#endif
@@ -1,89 +1,164 @@
 #include "screen.hpp"
 
+#include "frame.hpp"
+#include "sfml.hpp"
+#include "spsc_ring.hpp"
+
 #include <SFML/Graphics.hpp>
 
 #include <array>
+#include <atomic>
+#include <cstdio>
 
 namespace gem {
 
-struct Screen::Impl {
-    explicit Impl() {
-        std::array<u8, Screen::Width * Screen::Height * 4> texData;
-        for (std::size_t i = 0; i < Screen::Width * Screen::Height; ++i) {
-            texData[0u + i * 4u] = 0xFF;
-            texData[1u + i * 4u] = 0x00;
-            texData[2u + i * 4u] = 0xFF;
-            texData[3u + i * 4u] = 0xFF;
-        }
-        sf::Image screenImage;
-        screenImage.create(Screen::Width, Screen::Height, texData.data());
-        screenTexture.loadFromImage(screenImage);
-        screenSprite.setTexture(screenTexture);
-        screenSprite.setScale(static_cast<float>(Window::Scale),
-                              static_cast<float>(Window::Scale));
+namespace {
+using Pixels = std::array<u8, Screen::Width * Screen::Height * 4>;
+
+// frames on their way from the emulator to the window: one being written,
+// the newest finished one and one being shown. neither side ever waits for
+// the other; a frame the window doesn't get to before the next one is
+// finished is dropped.
+struct TripleBuffer {
+    // emulator side: where the next frame goes, and handing it over once
+    // it's there
+    Pixels& back() { return buffers[writing]; }
+    void publish() {
+        const u8 old = latest.exchange(u8(writing | Fresh),
+                                       std::memory_order_acq_rel);
+        writing = old & Index;
     }
 
-    void renderLine(const std::array<u8, Screen::Width * 4>& line,
-                    const unsigned y) {
-        screenTexture.update(line.data(), Screen::Width, 1u, 0, y);
+    // window side: the newest frame, or null if it's had it already
+    const Pixels* take() {
+        if ((latest.load(std::memory_order_relaxed) & Fresh) == 0) {
+            return nullptr;
+        }
+        const u8 old = latest.exchange(showing, std::memory_order_acq_rel);
+        showing = old & Index;
+        return &buffers[showing];
     }
 
-    sf::Texture screenTexture;
-    sf::Sprite screenSprite;
+   private:
+    enum : u8 {
+        Index = 0b011,
+        Fresh = 0b100,
+    };
+    std::array<Pixels, 3> buffers = {};
+    // the buffer holding the newest frame, and whether it's been taken
+    std::atomic<u8> latest{1};
+    u8 writing = 0;
+    u8 showing = 2;
 };
+}  // namespace
+
+// frames are converted straight into the window's buffers
+struct Screen::Impl {};
 
 Screen::Screen(Window& window)
     : window{window}, impl{std::make_unique<Impl>()} {}
 Screen::~Screen() = default;
 
-void Screen::renderLine(const std::array<u8, Width * 4>& line,
-                        const unsigned y) {
-    impl->renderLine(line, y);
-}
-
-void Screen::vblank() {
-    window.get().draw(*this);
-}
-
 struct Window::Impl {
-    explicit Impl()
-        : window{sf::VideoMode{Screen::Width * Scale, Screen::Height * Scale},
-                 "gem"} {
+    // window side, from sfml::show(): shows the newest frame at every
+    // refresh, so uploading and vsync never hold up emulation
+    void run() {
+        sf::RenderWindow window{
+              sf::VideoMode{Screen::Width * Scale, Screen::Height * Scale},
+              "gem"};
         window.setFramerateLimit(60);
         window.setVerticalSyncEnabled(true);
-    }
 
-    bool isOpen() const { return window.isOpen(); }
-    void processEvents() {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) {
-                window.close();
+        sf::Image placeholder;
+        placeholder.create(Screen::Width, Screen::Height, sf::Color::Magenta);
+        sf::Texture texture;
+        texture.loadFromImage(placeholder);
+        sf::Sprite sprite{texture};
+        sprite.setScale(static_cast<float>(Scale), static_cast<float>(Scale));
+
+        double shownSpeed = 0.0;
+        while (open) {
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                handle(event);
+            }
+            if (const double now = speed; now != shownSpeed) {
+                std::array<char, 32> title;
+                std::snprintf(title.data(), title.size(), "gem - %.2fx", now);
+                window.setTitle(title.data());
+                shownSpeed = now;
             }
+            if (const Pixels* const pixels = frames.take()) {
+                texture.update(pixels->data());
+            }
+            window.clear();
+            window.draw(sprite);
+            window.display();
         }
     }
 
-    void draw(const Screen& screen) {
-        window.clear();
-        window.draw(screen.getImpl().screenSprite);
-        window.display();
-        processEvents();
+    void handle(const sf::Event& event) {
+        if (event.type == sf::Event::Closed) {
+            open = false;
+            return;
+        }
+        if (event.type != sf::Event::KeyPressed &&
+            event.type != sf::Event::KeyReleased) {
+            return;
+        }
+        if (event.key.code == sf::Keyboard::Key::Tab) {
+            fastForward = event.type == sf::Event::KeyPressed;
+        } else if (const auto button = sfml::buttonForKey(event.key.code)) {
+            const sfml::ButtonEvent buttonEvent{
+                  *button, event.type == sf::Event::KeyPressed};
+            waitUntil([&] { return !open || input.push(buttonEvent); });
+        }
     }
 
-    sf::RenderWindow window;
+    // emulator side
+    void processEvents() {
+        while (const auto event = input.pop()) {
+            sfml::setButtonPressed(event->button, event->pressed);
+        }
+    }
+
+    TripleBuffer frames = {};
+    SPSCRing<sfml::ButtonEvent, 64> input = {};
+    std::atomic<bool> open{true};
+    std::atomic<bool> fastForward{false};
+    std::atomic<double> speed{0.0};
 };
 
+void Screen::vblank(const Frame* const frame) {
+    Window::Impl& windowImpl = window.get().getImpl();
+    if (frame != nullptr) {
+        frame->convert(Frame::Format::RGBA8888,
+                       windowImpl.frames.back().data());
+        windowImpl.frames.publish();
+    }
+    windowImpl.processEvents();
+}
+
 Window::Window() : impl{std::make_unique<Impl>()} {}
 Window::~Window() = default;
 
 bool Window::isOpen() const {
-    return impl->isOpen();
+    return impl->open;
 }
 void Window::processEvents() {
     impl->processEvents();
 }
-void Window::draw(const Screen& screen) {
-    impl->draw(screen);
+
+void sfml::show(Window& window) {
+    window.getImpl().run();
+}
+
+bool sfml::fastForwardHeld(const Window& window) {
+    return window.getImpl().fastForward;
+}
+
+void sfml::showSpeed(Window& window, const double speed) {
+    window.getImpl().speed = speed;
 }
 
 }  // namespace gem
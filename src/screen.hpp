@@ -8,6 +8,7 @@
 
 namespace gem {
 
+struct Frame;
 struct Window;
 
 struct Screen {
@@ -22,9 +23,9 @@ struct Screen {
 
     Impl& getImpl() const { return *impl; }
 
-    void renderLine(const std::array<u8, Width * 4>& line, const unsigned y);
-
-    void vblank();
+    // called at the start of every VBlank with the newest frame to show, or
+    // null if there's none. it mustn't wait on the display.
+    void vblank(const Frame* frame);
 
    private:
     std::reference_wrapper<Window> window;
@@ -33,19 +34,20 @@ struct Screen {
 
 struct Window {
    public:
+    struct Impl;
+
     static constexpr unsigned Scale = 6;
 
     explicit Window();
     ~Window();
 
+    Impl& getImpl() const { return *impl; }
+
     bool isOpen() const;
 
     void processEvents();
 
-    void draw(const Screen& screen);
-
    private:
-    struct Impl;
     std::unique_ptr<Impl> impl;
 };
 
@@ -0,0 +1,42 @@
+#ifndef GEM_SFML_HPP
+#define GEM_SFML_HPP
+
+#include "fwd.hpp"
+#include "input.hpp"
+#include "screen.hpp"
+
+#include <SFML/Window/Keyboard.hpp>
+
+#include <optional>
+
+// the SFML backend: a window on the main thread, which shows the frames the
+// emulator thread hands it at its own pace and sends key presses back as
+// button events.
+
+namespace gem {
+namespace sfml {
+
+struct ButtonEvent {
+    Input::Button button;
+    bool pressed;
+};
+
+// the button `key` is mapped to, if any
+std::optional<Input::Button> buttonForKey(sf::Keyboard::Key key);
+
+// what Input::isButtonPressed() reports from now on. emulator thread only.
+void setButtonPressed(Input::Button button, bool pressed);
+
+// opens `window` and shows frames in it until it's closed. main thread
+// only: that's the only one macOS delivers window events to.
+void show(Window& window);
+
+// whether the fast-forward key (Tab) is held down
+bool fastForwardHeld(const Window& window);
+// puts `speed`, a multiple of real time, in the window's title
+void showSpeed(Window& window, double speed);
+
+}  // namespace sfml
+}  // namespace gem
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef GEM_SPSC_RING_HPP
+#define GEM_SPSC_RING_HPP
+
+#include "fwd.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <thread>
+
+namespace gem {
+
+// a fixed-size queue from exactly one producer thread to exactly one
+// consumer thread, without locks. `Capacity` must be a power of two.
+template <typename T, usize Capacity>
+struct SPSCRing {
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0);
+
+    // producer only. false if the ring is full.
+    bool push(const T& value) {
+        const usize back = tail.load(std::memory_order_relaxed);
+        if (back - head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots[back % Capacity] = value;
+        tail.store(back + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only
+    std::optional<T> pop() {
+        const usize front = head.load(std::memory_order_relaxed);
+        if (front == tail.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        T value = slots[front % Capacity];
+        head.store(front + 1, std::memory_order_release);
+        return value;
+    }
+
+   private:
+    std::array<T, Capacity> slots = {};
+    // counts of values pushed and popped, each written by one side only
+    alignas(64) std::atomic<usize> head{0};
+    alignas(64) std::atomic<usize> tail{0};
+};
+
+// waits for `ready()` to hold without keeping a core busy for long: it
+// yields at first, then sleeps in short steps
+template <typename Ready>
+void waitUntil(Ready&& ready) {
+    for (unsigned tries = 0; !ready(); ++tries) {
+        if (tries < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+}  // namespace gem
+
+#endif
@@ -0,0 +1,20 @@
+#include "tile_atlas.hpp"
+
+namespace gem {
+
+void TileAtlas::decodeDirty(const u8* const vram) {
+    for (usize tile = 0; tile < Tiles; ++tile) {
+        if (!dirty.test(tile)) {
+            continue;
+        }
+        const u8* const data = vram + tile * 16;
+        for (unsigned y = 0; y < 8; ++y) {
+            const pixels::TileRow row{data[y * 2], data[y * 2 + 1]};
+            tiles[tile].rows[y] = pixels::decode(row);
+            flipped[tile].rows[y] = pixels::decode(row, true);
+        }
+    }
+    dirty.reset();
+}
+
+}  // namespace gem
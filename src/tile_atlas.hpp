@@ -0,0 +1,54 @@
+#ifndef GEM_TILE_ATLAS_HPP
+#define GEM_TILE_ATLAS_HPP
+
+#include "fwd.hpp"
+
+#include "pixels.hpp"
+
+#include <array>
+#include <bitset>
+
+namespace gem {
+
+// every tile in VRAM decoded to colour codes, plus each one mirrored for
+// sprites with X flip. a decoded tile is exactly one cache line. writes only
+// mark tiles dirty; they're decoded again in one go the next time the atlas
+// is read.
+struct TileAtlas {
+    static constexpr usize Tiles = 384;
+
+    TileAtlas() { dirty.set(); }
+
+    // after a write to tile data, `address` relative to the start of VRAM
+    void invalidate(const u16 address) { dirty.set(address / 16u); }
+
+    // decodes the dirty tiles again from `vram`
+    void refresh(const u8* const vram) {
+        if (dirty.any()) {
+            decodeDirty(vram);
+        }
+    }
+
+    const pixels::Row& row(const usize tile, const unsigned y) const {
+        return tiles[tile].rows[y];
+    }
+    const pixels::Row& flippedRow(const usize tile, const unsigned y) const {
+        return flipped[tile].rows[y];
+    }
+
+   private:
+    struct alignas(64) Tile {
+        std::array<pixels::Row, 8> rows;
+    };
+    static_assert(sizeof(Tile) == 64);
+
+    void decodeDirty(const u8* vram);
+
+    std::array<Tile, Tiles> tiles = {};
+    std::array<Tile, Tiles> flipped = {};
+    std::bitset<Tiles> dirty = {};
+};
+
+}  // namespace gem
+
+#endif
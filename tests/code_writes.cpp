@@ -0,0 +1,116 @@
+#include "machine.hpp"
+
+#include <array>
+
+// loops in WRAM that rewrite their own instructions while they run: with a
+// byte store, with LD (nn),SP, which writes a word, and through the echo of
+// WRAM at 0xE000. every mode that caches code has to drop the block it's
+// running and see the new instruction on the next pass, exactly as the
+// interpreter does, tick for tick. each loop makes only one kind of store,
+// since any store into a block drops every block on its page.
+
+namespace {
+using namespace gem;
+
+constexpr u16 Loop = 0xC000;
+constexpr u8 Passes = 0x40;
+
+constexpr std::array<u8, 0x3C> program = {
+      // B: what the previous pass stored over its operand
+      0x06, 0x00,              // C000 LD B, n
+      0x3C,                    // C002 INC A
+      0xEA, 0x01, 0xC0,        // C003 LD (C001), A
+      0xFE, Passes,            // C006 CP Passes
+      0x20, 0xF6,              // C008 JR NZ, C000
+      // HL: the previous pass's SP, as a word
+      0x21, 0x00, 0x00,        // C00A LD HL, nn
+      0x3B,                    // C00D DEC SP
+      0x08, 0x0B, 0xC0,        // C00E LD (C00B), SP
+      0x3D,                    // C011 DEC A
+      0x20, 0xF6,              // C012 JR NZ, C00A
+      // C: stored through echo RAM, and kept in HRAM
+      0x0E, 0x00,              // C014 LD C, n
+      0x3C,                    // C016 INC A
+      0xEA, 0x15, 0xE0,        // C017 LD (E015), A
+      0xFE, Passes,            // C01A CP Passes
+      0x20, 0xF6,              // C01C JR NZ, C014
+      0x79,                    // C01E LD A, C
+      0xE0, 0x80,              // C01F LDH (80), A
+      0x3E, Passes,            // C021 LD A, Passes
+      // D: stored a few instructions earlier in the same pass
+      0x3D,                    // C023 DEC A
+      0xEA, 0x28, 0xC0,        // C024 LD (C028), A
+      0x16, 0xFF,              // C027 LD D, n
+      0x20, 0xF8,              // C029 JR NZ, C023
+      // E: a block run often enough to be hot, patched from outside it
+      0x0E, 0x20,              // C02B LD C, 0x20
+      0x1E, 0xFF,              // C02D LD E, n
+      0x0D,                    // C02F DEC C
+      0x20, 0xFB,              // C030 JR NZ, C02D
+      0x3C,                    // C032 INC A
+      0xEA, 0x2E, 0xC0,        // C033 LD (C02E), A
+      0xFE, 0x04,              // C036 CP 4
+      0x20, 0xF1,              // C038 JR NZ, C02B
+      0x18, 0xFE,              // C03A JR C03A
+};
+constexpr u16 Done = 0xC03A;
+
+// clears A and jumps to the loop
+Mem::Block rom() {
+    Mem::Block rom(0x8000, 0x00);
+    rom[0x100] = 0xAF;
+    rom[0x101] = 0xC3;
+    rom[0x102] = Loop & 0xFF;
+    rom[0x103] = Loop >> 8;
+    return rom;
+}
+
+void load(test::Machine& machine, const GameBoy::CPUMode mode) {
+    machine.gameBoy.setCPUMode(mode);
+    for (u16 i = 0; i < program.size(); ++i) {
+        machine.gameBoy.mem.write(u16(Loop + i), program[i]);
+    }
+}
+
+void run(const GameBoy::CPUMode mode, const char* name) {
+    test::Machine reference{rom()};
+    test::Machine machine{rom()};
+    load(reference, GameBoy::CPUMode::Interpreter);
+    load(machine, mode);
+
+    for (;;) {
+        reference.gameBoy.step();
+        machine.gameBoy.step();
+        const CPU& cpu = machine.gameBoy.cpu;
+        // the block cache may stop early to skip the idle loop at the end
+        if (reference.gameBoy.cpu.reg.getPC() == Done) {
+            GEM_CHECK(cpu.reg.getPC() == Done, name << " didn't finish");
+            break;
+        }
+        GEM_CHECK(test::same(cpu, reference.gameBoy.cpu),
+                  name << ": " << test::describe(cpu) << ", the interpreter: "
+                       << test::describe(reference.gameBoy.cpu));
+    }
+
+    // every loop's last pass ran with the stores of the pass before
+    const Registers& reg = machine.gameBoy.cpu.reg;
+    GEM_CHECK(reg.getB() == Passes - 1,
+              name << " missed a byte store into its block");
+    GEM_CHECK(reg.getHL() == 0xFFFE - (Passes - 1),
+              name << " missed a word store into its block");
+    GEM_CHECK(machine.gameBoy.mem.read(0xFF80) == Passes - 1,
+              name << " missed a store through echo RAM into its block");
+    GEM_CHECK(reg.getD() == 0x00,
+              name << " missed a store to later in its block");
+    GEM_CHECK(reg.getE() == 0x03,
+              name << " missed a store into a hot block");
+}
+}  // namespace
+
+int main() {
+    using CPUMode = GameBoy::CPUMode;
+    run(CPUMode::Blocks, "blocks");
+#if GEM_JIT
+    run(CPUMode::JIT, "jit");
+#endif
+}
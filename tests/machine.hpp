@@ -0,0 +1,100 @@
+#ifndef GEM_TESTS_MACHINE_HPP
+#define GEM_TESTS_MACHINE_HPP
+
+#include "gameboy.hpp"
+#include "headless.hpp"
+#include "pixels.hpp"
+#include "screen.hpp"
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <utility>
+
+// what the tests share: a Game Boy on the headless frontend whose cartridge
+// never touches the LCD, so every picture it draws is one a test set up.
+
+// fails the test, in every build type, unless `condition` holds
+#define GEM_CHECK(condition, ...)                                   \
+    do {                                                            \
+        if (!(condition)) {                                         \
+            GEM_LOG(__FILE__ << ':' << __LINE__ << ": " << #condition \
+                             << ": " << __VA_ARGS__);               \
+            std::exit(1);                                           \
+        }                                                           \
+    } while (false)
+
+namespace gem {
+namespace test {
+
+// a cartridge that spins on `JR -2` at its entry point
+inline Mem::Block idleROM() {
+    Mem::Block rom(0x8000, 0x00);
+    rom[0x100] = 0x18;
+    rom[0x101] = 0xFE;
+    return rom;
+}
+
+// every line is checked against the reference renderer as it's drawn
+struct Machine {
+    explicit Machine(Mem::Block rom = idleROM())
+        : gameBoy{std::move(rom), screen} {
+        gameBoy.gpu.setVerifyRendering(true);
+    }
+
+    // runs until LY reads `line`
+    void runToLine(const unsigned line) {
+        while (gameBoy.mem.read(GPU::Registers::LY) != line) {
+            gameBoy.step();
+        }
+    }
+    // runs until the frame being drawn now is finished
+    void finishFrame() {
+        const unsigned long long before = frames();
+        while (frames() == before) {
+            gameBoy.step();
+        }
+    }
+    unsigned long long frames() const { return window.getImpl().frames; }
+
+    Window window{};
+    Screen screen{window};
+    GameBoy gameBoy;
+};
+
+// whether two CPUs are at the same tick with the same registers
+inline bool same(const CPU& a, const CPU& b) {
+    return a.getTicks() == b.getTicks() &&
+           a.reg.getAF() == b.reg.getAF() && a.reg.getBC() == b.reg.getBC() &&
+           a.reg.getDE() == b.reg.getDE() && a.reg.getHL() == b.reg.getHL() &&
+           a.reg.getSP() == b.reg.getSP() && a.reg.getPC() == b.reg.getPC();
+}
+
+inline std::string describe(const CPU& cpu) {
+    std::ostringstream out;
+    out << "ticks " << cpu.getTicks() << " AF " << hexString(cpu.reg.getAF())
+        << " BC " << hexString(cpu.reg.getBC()) << " DE "
+        << hexString(cpu.reg.getDE()) << " HL " << hexString(cpu.reg.getHL())
+        << " SP " << hexString(cpu.reg.getSP()) << " PC "
+        << hexString(cpu.reg.getPC());
+    return out.str();
+}
+
+// runs `test(simd)` at every SIMD level the host supports, then goes back to
+// the best one
+template <typename Test>
+void forEachSIMD(Test&& test) {
+    for (const pixels::SIMD simd : {pixels::SIMD::Scalar, pixels::SIMD::SSE2,
+                                    pixels::SIMD::SSSE3, pixels::SIMD::AVX2}) {
+        if (pixels::supported(simd)) {
+            pixels::use(simd);
+            test(simd);
+        }
+    }
+    pixels::use(pixels::best());
+}
+
+}  // namespace test
+}  // namespace gem
+
+#endif
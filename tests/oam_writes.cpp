@@ -0,0 +1,99 @@
+#include "machine.hpp"
+
+#include <array>
+
+// sprites written into OAM by the CPU, through Mem::write, rather than by
+// DMA: they have to read back, leave VRAM alone and be drawn where they are,
+// including when they're moved between frames or added mid-frame.
+
+namespace {
+using namespace gem;
+
+constexpr u8 SpriteTile = 1;
+
+// the address of byte `byte` of sprite `index`'s OAM entry
+u16 oam(const unsigned index, const unsigned byte) {
+    return u16(GPU::SpriteData::Start + index * GPU::SpriteData::OAMBlockSize +
+               byte);
+}
+
+// writes sprite `index` one byte at a time. `line` and `x` are where its
+// top left pixel goes on screen.
+void writeSprite(Mem& mem, const unsigned index, const u8 line, const u8 x) {
+    mem.write(oam(index, 0), u8(line + 16));
+    mem.write(oam(index, 1), u8(x + 8));
+    mem.write(oam(index, 2), SpriteTile);
+    mem.write(oam(index, 3), u8{0x00});
+}
+
+// whether the pixel at (`x`, `line`) of the last frame is black, which only
+// a sprite is: the background is off
+bool black(GPU& gpu, const unsigned line, const unsigned x) {
+    const Frame& frame = gpu.redrawFrame();
+    return frame.shade(line, frame.line(line)[x]) == 3;
+}
+}  // namespace
+
+int main() {
+    test::Machine machine;
+    Mem& mem = machine.gameBoy.mem;
+    GPU& gpu = machine.gameBoy.gpu;
+
+    // LCD and sprites on, background off; the sprite tile is solid black
+    mem.write(GPU::Registers::LCDC, u8{0x82});
+    mem.write(GPU::Registers::BGP, u8{0xE4});
+    mem.write(GPU::Registers::OBP0, u8{0xE4});
+    for (u16 i = 0; i < GPU::Tile::MemSize; ++i) {
+        mem.write(u16(GPU::TileSet1Start + SpriteTile * GPU::Tile::MemSize + i),
+                  u8{0xFF});
+    }
+    // where OAM writes once ended up
+    std::array<u8, GPU::SpriteData::End - GPU::SpriteData::Start> lowVRAM;
+    for (u16 i = 0; i < lowVRAM.size(); ++i) {
+        lowVRAM[i] = mem.read(u16(GPU::VideoRAMStart + i));
+    }
+
+    machine.runToLine(Screen::Height);
+    writeSprite(mem, 5, 40, 20);
+    // a word write covering two OAM bytes: Y, then X
+    mem.write(oam(6, 0), u16((100 + 8) << 8u | (90 + 16)));
+    mem.write(oam(6, 2), u16{SpriteTile});
+
+    GEM_CHECK(mem.read(oam(5, 0)) == 40 + 16, "OAM doesn't read back");
+    GEM_CHECK(mem.read(oam(5, 1)) == 20 + 8, "OAM doesn't read back");
+    GEM_CHECK(mem.read(oam(5, 2)) == SpriteTile, "OAM doesn't read back");
+    GEM_CHECK(mem.read(oam(6, 1)) == 100 + 8,
+              "word writes to OAM don't read back");
+    for (u16 i = 0; i < lowVRAM.size(); ++i) {
+        GEM_CHECK(mem.read(u16(GPU::VideoRAMStart + i)) == lowVRAM[i],
+                  "an OAM write changed VRAM at 0x" << std::hex
+                                                   << GPU::VideoRAMStart + i);
+    }
+
+    machine.runToLine(0);
+    machine.finishFrame();
+    GEM_CHECK(black(gpu, 40, 20) && black(gpu, 47, 27),
+              "a sprite written by the CPU wasn't drawn");
+    GEM_CHECK(!black(gpu, 39, 20) && !black(gpu, 48, 20) &&
+                    !black(gpu, 40, 28),
+              "a sprite written by the CPU was drawn too big");
+    GEM_CHECK(black(gpu, 90, 100), "a sprite written as words wasn't drawn");
+
+    // moved between frames
+    machine.runToLine(Screen::Height);
+    writeSprite(mem, 5, 120, 20);
+    machine.runToLine(0);
+    machine.finishFrame();
+    GEM_CHECK(!black(gpu, 40, 20), "a moved sprite stayed where it was");
+    GEM_CHECK(black(gpu, 120, 20), "a moved sprite wasn't drawn");
+
+    // added between lines, below the line being drawn
+    machine.runToLine(0);
+    machine.runToLine(60);
+    writeSprite(mem, 7, 80, 60);
+    machine.finishFrame();
+    GEM_CHECK(black(gpu, 80, 60), "a sprite added mid-frame wasn't drawn");
+
+    GEM_CHECK(gpu.mismatchedLines() == 0,
+              gpu.mismatchedLines() << " lines differ from the reference");
+}
@@ -0,0 +1,234 @@
+#include "machine.hpp"
+
+#include <iterator>
+#include <random>
+#include <vector>
+
+// loops in WRAM made of instructions picked at random, mostly from those the
+// JIT translates itself (loads, ALU ops, INC/DEC and conditional jumps over
+// the next few instructions) with a few of those it calls out for mixed in.
+// every mode that caches code has to run them tick for tick as the
+// interpreter does, also once an instruction hook is set (which compiled
+// code has built in) and after it's taken away again.
+//
+// H, L and SP are only set by each pass's prologue, and stores only go
+// through HL and to WRAM and HRAM, so a loop can't write over itself or
+// touch the hardware.
+
+namespace {
+using namespace gem;
+using Native = op::Native;
+
+constexpr u16 Loop = 0xC000;
+constexpr unsigned Programs = 48;
+constexpr unsigned Instructions = 24;
+constexpr unsigned Steps = 6000;
+
+// clears A and jumps to the loop
+Mem::Block rom() {
+    Mem::Block rom(0x8000, 0x00);
+    rom[0x100] = 0xAF;
+    rom[0x101] = 0xC3;
+    rom[0x102] = Loop & 0xFF;
+    rom[0x103] = Loop >> 8;
+    return rom;
+}
+
+bool writes(const Native::Loc loc) {
+    switch (loc) {
+        case Native::Loc::H:
+        case Native::Loc::L:
+        case Native::Loc::AtBC:
+        case Native::Loc::AtDE:
+        case Native::Loc::AtHighC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// instructions a loop may be made of, apart from jumps
+std::vector<std::vector<u8>> candidates() {
+    std::vector<std::vector<u8>> result;
+    for (unsigned opcode = 0; opcode < 0x100; ++opcode) {
+        const Native& native = op::decodeTable[opcode].native;
+        if (native.kind != Native::Kind::Call &&
+            native.kind != Native::Kind::Jump && !writes(native.dst)) {
+            result.push_back({u8(opcode)});
+        }
+    }
+    // rotates, DAA, CPL, SCF, CCF, ADC and SBC
+    for (const unsigned opcode :
+         {0x07, 0x0F, 0x17, 0x1F, 0x27, 0x2F, 0x37, 0x3F}) {
+        result.push_back({u8(opcode)});
+    }
+    for (unsigned opcode = 0x88; opcode <= 0x9F; ++opcode) {
+        if ((opcode & 0xF0) != 0x90 || opcode >= 0x98) {
+            result.push_back({u8(opcode)});
+        }
+    }
+    // 0xCB-prefixed ones on A-E
+    for (unsigned opcode = 0; opcode < 0x100; ++opcode) {
+        if ((opcode & 7u) <= 3 || (opcode & 7u) == 7) {
+            result.push_back({0xCB, u8(opcode)});
+        }
+    }
+    return result;
+}
+
+struct Generator {
+    explicit Generator(const unsigned seed) : rng{seed} {}
+
+    u16 between(const u16 first, const u16 last) {
+        return u16(first + rng() % (last - first + 1u));
+    }
+
+    // a pass: pointers into WRAM, the instructions, and back to the start
+    std::vector<u8> program() {
+        std::vector<u8> code = {
+              0x01, 0x00, 0xD0,  // LD BC, D000
+              0x11, 0x00, 0xD1,  // LD DE, D100
+              0x21, 0x00, 0xD2,  // LD HL, D200
+              0x31, 0xF0, 0xDF,  // LD SP, DFF0
+        };
+        // a jump over the instructions that follow it, and how many
+        usize jump = 0;
+        unsigned skipped = 0;
+        for (unsigned i = 0; i < Instructions; ++i) {
+            if (skipped == 0 && jump != 0) {
+                land(code, jump);
+                jump = 0;
+            }
+            if (jump == 0 && rng() % 6 == 0) {
+                jump = addJump(code);
+                skipped = 1 + unsigned(rng() % 3);
+            } else {
+                add(code, pick());
+                skipped = skipped == 0 ? 0 : skipped - 1;
+            }
+        }
+        if (jump != 0) {
+            land(code, jump);
+        }
+        const auto back = i8(-i64(code.size()) - 2);
+        code.push_back(0x18);  // JR Loop
+        code.push_back(u8(back));
+        return code;
+    }
+
+   private:
+    const std::vector<u8>& pick() {
+        return instructions[rng() % instructions.size()];
+    }
+
+    // appends `instruction` with an operand that keeps its stores in RAM
+    void add(std::vector<u8>& code, const std::vector<u8>& instruction) {
+        code.insert(code.end(), instruction.begin(), instruction.end());
+        if (instruction.size() > 1) {
+            return;
+        }
+        const op::DecodeInfo& info = op::decodeTable[instruction[0]];
+        if (info.operandBytes == 1) {
+            code.push_back(info.native.dst == Native::Loc::AtHighOperand
+                                 ? u8(between(0x80, 0xFE))
+                                 : u8(rng()));
+        } else if (info.operandBytes == 2) {
+            const u16 operand = info.native.dst == Native::Loc::HL
+                                      ? between(0xD200, 0xD2FF)
+                                      : between(0xD000, 0xDEFF);
+            code.push_back(u8(operand));
+            code.push_back(u8(operand >> 8u));
+        }
+    }
+
+    // appends JR or JP, maybe conditional, to be pointed at a later
+    // instruction by land(). returns where its operand is.
+    usize addJump(std::vector<u8>& code) {
+        static constexpr u8 jumps[] = {0x18, 0x20, 0x28, 0x30, 0x38,
+                                       0xC3, 0xC2, 0xCA, 0xD2, 0xDA};
+        const u8 opcode = jumps[rng() % std::size(jumps)];
+        code.push_back(opcode);
+        const usize operand = code.size();
+        code.resize(code.size() + op::decodeTable[opcode].operandBytes);
+        return operand;
+    }
+    void land(std::vector<u8>& code, const usize operand) {
+        if (code[operand - 1] < 0x40) {
+            code[operand] = u8(code.size() - operand - 1);
+        } else {
+            const u16 target = u16(Loop + code.size());
+            code[operand] = u8(target);
+            code[operand + 1] = u8(target >> 8u);
+        }
+    }
+
+    std::mt19937 rng;
+    std::vector<std::vector<u8>> instructions = candidates();
+};
+
+// counts and sums the PCs of the instructions it's called after
+struct Trace {
+    static void hook(void* context, const CPU& cpu) {
+        auto& trace = *static_cast<Trace*>(context);
+        ++trace.instructions;
+        trace.pcs += cpu.reg.getPC();
+    }
+    unsigned long long instructions = 0;
+    unsigned long long pcs = 0;
+};
+
+void run(const GameBoy::CPUMode mode, const char* name) {
+    for (unsigned seed = 0; seed < Programs; ++seed) {
+        const std::vector<u8> program = Generator{seed}.program();
+        test::Machine reference{rom()};
+        test::Machine machine{rom()};
+        reference.gameBoy.setCPUMode(GameBoy::CPUMode::Interpreter);
+        machine.gameBoy.setCPUMode(mode);
+        for (u16 i = 0; i < program.size(); ++i) {
+            reference.gameBoy.mem.write(u16(Loop + i), program[i]);
+            machine.gameBoy.mem.write(u16(Loop + i), program[i]);
+        }
+
+        Trace referenceTrace;
+        Trace trace;
+        for (unsigned step = 0; step < Steps; ++step) {
+            if (step == Steps / 3) {
+                reference.gameBoy.cpu.setInstructionHook(&Trace::hook,
+                                                         &referenceTrace);
+                machine.gameBoy.cpu.setInstructionHook(&Trace::hook, &trace);
+            } else if (step == 2 * Steps / 3) {
+                reference.gameBoy.cpu.setInstructionHook(nullptr, nullptr);
+                machine.gameBoy.cpu.setInstructionHook(nullptr, nullptr);
+            }
+            reference.gameBoy.step();
+            machine.gameBoy.step();
+            const CPU& cpu = machine.gameBoy.cpu;
+            GEM_CHECK(test::same(cpu, reference.gameBoy.cpu),
+                      name << ", program " << seed << ", step " << step
+                           << ": " << test::describe(cpu)
+                           << ", the interpreter: "
+                           << test::describe(reference.gameBoy.cpu));
+        }
+        GEM_CHECK(trace.instructions == referenceTrace.instructions &&
+                        trace.pcs == referenceTrace.pcs,
+                  name << ", program " << seed << ": the hook saw "
+                       << trace.instructions << " instructions, "
+                       << referenceTrace.instructions
+                       << " under the interpreter");
+        for (u16 address = 0xD000; address < 0xE000; ++address) {
+            GEM_CHECK(machine.gameBoy.mem.read(address) ==
+                            reference.gameBoy.mem.read(address),
+                      name << ", program " << seed << ": WRAM differs at "
+                           << hexString(address));
+        }
+    }
+}
+}  // namespace
+
+int main() {
+    using CPUMode = GameBoy::CPUMode;
+    run(CPUMode::Blocks, "blocks");
+#if GEM_JIT
+    run(CPUMode::JIT, "jit");
+#endif
+}
@@ -0,0 +1,132 @@
+#include "machine.hpp"
+
+#include <random>
+
+// writes to VRAM, OAM and LCDC at random between lines, through Mem like the
+// CPU does, so the renderer's caches, sprite buckets and choice of line
+// drawer have to keep up with changes in the middle of a frame, and checks
+// every line drawn against the reference renderer at every SIMD level the
+// host supports.
+
+namespace {
+using namespace gem;
+
+constexpr unsigned Frames = 120;
+
+struct Fuzzer {
+    explicit Fuzzer(const unsigned seed) : rng{seed} {}
+
+    u8 byte() { return u8(rng()); }
+    // true one time in `n`
+    bool oneIn(const unsigned n) { return rng() % n == 0; }
+    u16 between(const u16 first, const u16 last) {
+        return u16(first + rng() % (last - first + 1u));
+    }
+
+    // tile data: single bytes, and whole rows written as words
+    void writeTiles(Mem& mem) {
+        for (unsigned n = rng() % 8; n != 0; --n) {
+            mem.write(between(GPU::TileSet1Start, GPU::TileSet0End - 1),
+                      byte());
+        }
+        if (oneIn(4)) {
+            const u16 row = u16(between(GPU::TileSet1Start,
+                                        GPU::TileSet0End - 2) & ~1u);
+            mem.write(row, u16(rng()));
+        }
+    }
+    // tile map entries, here and there and in runs
+    void writeMaps(Mem& mem) {
+        for (unsigned n = rng() % 4; n != 0; --n) {
+            mem.write(between(GPU::TileMap0Start, GPU::TileMap1End - 1),
+                      byte());
+        }
+        if (oneIn(16)) {
+            const u16 start =
+                  between(GPU::TileMap0Start, GPU::TileMap1End - 32);
+            for (u16 i = 0; i < 32; ++i) {
+                mem.write(u16(start + i), byte());
+            }
+        }
+    }
+    // sprites: stray OAM bytes, now and then a crowd of them on one line,
+    // several sharing an X, and now and then a whole table by DMA
+    void writeSprites(Mem& mem) {
+        for (unsigned n = rng() % 4; n != 0; --n) {
+            mem.write(between(GPU::SpriteData::Start, GPU::SpriteData::End - 1),
+                      byte());
+        }
+        if (oneIn(16)) {
+            const u8 y = u8(rng() % 160);
+            const u8 x = u8(rng() % 168);
+            for (unsigned n = 0; n < 12; ++n) {
+                const u16 entry = u16(GPU::SpriteData::Start +
+                                      rng() % GPU::SpriteData::TotalSprites *
+                                            GPU::SpriteData::OAMBlockSize);
+                mem.write(entry, u8(y + rng() % 8));
+                mem.write(u16(entry + 1), oneIn(2) ? x : u8(rng() % 176));
+            }
+        }
+        if (oneIn(64)) {
+            for (u16 i = 0; i < GPU::SpriteData::End - GPU::SpriteData::Start;
+                 ++i) {
+                mem.write(u16(0xC000 + i), byte());
+            }
+            mem.write(GPU::Registers::DMA, u8{0xC0});
+        }
+    }
+    // a new LCDC, which switches line drawers, keeping the LCD on
+    void writeLCDC(Mem& mem) {
+        if (oneIn(8)) {
+            mem.write(GPU::Registers::LCDC, u8(0x80 | byte()));
+        }
+    }
+    void writeScroll(Mem& mem) {
+        if (oneIn(8)) {
+            mem.write(GPU::Registers::SCROLLX, byte());
+            mem.write(GPU::Registers::SCROLLY, byte());
+        }
+        if (oneIn(16)) {
+            mem.write(GPU::Registers::WNDPOSX, u8(rng() % 168));
+            mem.write(GPU::Registers::WNDPOSY, u8(rng() % 144));
+        }
+    }
+
+    std::mt19937 rng;
+};
+
+void fuzz(const pixels::SIMD simd) {
+    Fuzzer fuzzer{17};
+    test::Machine machine;
+    Mem& mem = machine.gameBoy.mem;
+    for (u32 address = GPU::VideoRAMStart; address < GPU::VideoRAMEnd;
+         ++address) {
+        mem.write(u16(address), fuzzer.byte());
+    }
+    mem.write(GPU::Registers::BGP, u8{0xE4});
+    mem.write(GPU::Registers::OBP0, u8{0xD2});
+    mem.write(GPU::Registers::OBP1, u8{0x1B});
+
+    for (unsigned frame = 0; frame < Frames; ++frame) {
+        machine.runToLine(0);
+        mem.write(GPU::Registers::LCDC, u8(0x80 | fuzzer.byte()));
+        for (unsigned line = 0; line < Screen::Height; ++line) {
+            machine.runToLine(line);
+            fuzzer.writeTiles(mem);
+            fuzzer.writeMaps(mem);
+            fuzzer.writeSprites(mem);
+            fuzzer.writeLCDC(mem);
+            fuzzer.writeScroll(mem);
+        }
+        machine.finishFrame();
+        GEM_CHECK(machine.gameBoy.gpu.mismatchedLines() == 0,
+                  "frame " << frame << " with " << pixels::name(simd) << ": "
+                           << machine.gameBoy.gpu.mismatchedLines()
+                           << " lines differ from the reference");
+    }
+}
+}  // namespace
+
+int main() {
+    test::forEachSIMD(fuzz);
+}
@@ -1,6 +1,7 @@
 #!/usr/bin/env python
 
 import imp
+import re
 import sys
 import os
 import os.path
@@ -15,6 +16,9 @@ _GEN_SKELETON = """\
 # include "alu.hpp"
 # include "cpu.hpp"
 
+# include <array>
+# include <vector>
+
 using gem::hexString;
 
 # ifndef NDEBUG
@@ -35,8 +39,22 @@ using gem::hexString;
 namespace {{
 {helper_functions}
 {defs}
+{exec_defs}
 }}
 
+const std::array<gem::op::DecodeInfo, 256> gem::op::decodeTable = {{{{
+    {decode_table}
+}}}};
+{prefix_decode_tables}
+
+namespace {{
+{fused_defs}
+}}
+
+const std::vector<gem::op::Fusion> gem::op::fusions = {{
+    {fusions}
+}};
+
 # if GEM_DEBUG_LOGGING
 namespace {{
 gem::TinyString<23> getOpcodeDescription(const gem::u8 code, const gem::CPU& cpu) {{
@@ -91,6 +109,103 @@ gem::DeltaTicks gem::op::runOpcode(const gem::u8 opcode, gem::CPU& cpu) {{
     }}
     UNIMPLEMENTED_OPCODE(opcode);
 }}
+{threaded}"""
+
+
+_THREADED_SKELETON = """
+# if GEM_GCC_CLANG
+// taking the address of a label is a GNU extension
+# pragma GCC diagnostic ignored "-Wpedantic"
+# define GEM_COMPUTED_GOTO true
+# else
+# define GEM_COMPUTED_GOTO false
+# endif
+
+# ifndef NDEBUG
+# define GEM_BEFORE_OPCODE()                                 \\
+    do {{                                                     \\
+        if (doVerbosePrint()) {{                              \\
+            verbosePrint(opcode, cpu);                       \\
+        }}                                                    \\
+        if (op::pcBreakpoints.contains(cpu.reg.getPC() - 1)) {{ \\
+            GEM_BREAKPOINT();                                \\
+        }}                                                    \\
+    }} while (false)
+# else
+# define GEM_BEFORE_OPCODE()          \\
+    do {{                              \\
+        if (doVerbosePrint()) {{       \\
+            verbosePrint(opcode, cpu); \\
+        }}                             \\
+    }} while (false)
+# endif
+
+# if GEM_COMPUTED_GOTO
+# define GEM_DISPATCH(TABLE, SWITCH) goto* TABLE[opcode]
+# else
+# define GEM_DISPATCH(TABLE, SWITCH) goto SWITCH
+# endif
+
+// retires the instruction that just ran and jumps straight to the handler of
+// the next one, so every handler ends in its own indirect branch
+# define GEM_NEXT(TICKS)                              \\
+    do {{                                              \\
+        cpu.retire(TICKS);                            \\
+        if (!cpu.continueRun(elapsed, budget)) {{      \\
+            return elapsed;                           \\
+        }}                                             \\
+        if (GEM_UNLIKELY(!cpu.isRunning())) {{         \\
+            goto idle;                                \\
+        }}                                             \\
+        opcode = cpu.readPC();                        \\
+        GEM_BEFORE_OPCODE();                          \\
+        GEM_DISPATCH(dispatchTable, dispatchSwitch);  \\
+    }} while (false)
+
+gem::DeltaTicks gem::op::runThreaded(gem::CPU& cpu, const gem::Ticks budget) {{
+    using namespace gem;
+# if GEM_COMPUTED_GOTO
+    static void* const dispatchTable[256] = {{
+        {table}
+    }};
+    {prefix_tables}
+# endif
+    DeltaTicks elapsed = 0;
+    u8 opcode = 0;
+    if (!cpu.isRunning()) {{
+        goto idle;
+    }}
+    opcode = cpu.readPC();
+    GEM_BEFORE_OPCODE();
+    GEM_DISPATCH(dispatchTable, dispatchSwitch);
+
+idle:
+    cpu.idle(budget - elapsed);
+    if (!cpu.continueRun(elapsed, budget)) {{
+        return elapsed;
+    }}
+    if (!cpu.isRunning()) {{
+        goto idle;
+    }}
+    opcode = cpu.readPC();
+    GEM_BEFORE_OPCODE();
+    GEM_DISPATCH(dispatchTable, dispatchSwitch);
+
+    {handlers}
+
+unimplemented:
+    UNIMPLEMENTED_OPCODE(opcode);
+    return elapsed;
+
+# if !GEM_COMPUTED_GOTO
+dispatchSwitch:
+    switch (opcode) {{
+        {switch_cases}
+    }}
+    goto unimplemented;
+    {prefix_switches}
+# endif
+}}
 """
 
 
@@ -121,6 +236,181 @@ def make_defs(ops):
     return '\n'.join(make_def(op) for op in ops)
 
 
+# the block cache runs pre-decoded instructions: the same implementations, but
+# with the immediate operand passed in instead of read from PC
+def make_exec_impl(op):
+    return op.implementation \
+        .replace('cpu.readPC16()', 'operand') \
+        .replace('cpu.readPC()', 'gem::u8(operand)')
+
+
+def operand_bytes(op):
+    if 'cpu.readPC16()' in op.implementation:
+        return 2
+    if 'cpu.readPC()' in op.implementation:
+        return 1
+    return 0
+
+
+def max_ticks(op):
+    return op.ticks + sum(int(t) for t in re.findall(r'ticks \+= (\d+);', op.implementation))
+
+
+_BLOCK_ENDERS = ('setPC', 'ret_impl', 'JP_nn_impl', 'JR_n_impl', 'call_impl',
+                 'cpu.returnFromInterrupt', 'cpu.halt', 'cpu.stop', 'cpu.ei', 'cpu.di')
+
+
+def ends_block(op):
+    return op.is_jump or any(e in op.implementation for e in _BLOCK_ENDERS)
+
+
+_SIDE_EFFECTS = ('cpu.bus.write', 'pushStack', 'call_impl', 'cpu.returnFromInterrupt',
+                 'cpu.halt', 'cpu.stop', 'cpu.ei', 'cpu.di')
+
+
+def is_pure(op):
+    return not any(e in op.implementation for e in _SIDE_EFFECTS)
+
+
+_READS = (('cpu.bus.read(cpu.reg.getBC())', 'BC'),
+          ('cpu.bus.read(cpu.reg.getDE())', 'DE'),
+          ('cpu.bus.read(cpu.reg.getHL())', 'HL'),
+          ('cpu.bus.read(cpu.readPC16())', 'Operand'),
+          ('cpu.bus.read(0xFF00 + cpu.reg.getC())', 'HighC'),
+          ('cpu.bus.read(0xFF00 + cpu.readPC())', 'HighOperand'),
+          ('popStack', 'Stack'),
+          ('ret_impl', 'Stack'))
+
+
+def reads(op):
+    for pattern, kind in _READS:
+        if pattern in op.implementation:
+            return kind
+    if 'cpu.bus.read' in op.implementation:
+        raise Exception('unknown memory read in {}'.format(op.name))
+    return 'Nothing'
+
+
+# what the JIT translates to host code itself, rather than calling exec_:
+# loads, 8-bit ALU ops, INC/DEC and jumps, recognised by their
+# implementations. anything else is Call.
+_R8 = r'(A|B|C|D|E|H|L)'
+_ADDRESSES = (('cpu.reg.getBC()', 'AtBC'),
+              ('cpu.reg.getDE()', 'AtDE'),
+              ('cpu.reg.getHL()', 'AtHL'),
+              ('cpu.readPC16()', 'AtOperand'),
+              ('0xFF00 + cpu.reg.getC()', 'AtHighC'),
+              ('0xFF00 + cpu.readPC()', 'AtHighOperand'))
+_ALU = {'add8': 'Add', 'sub8': 'Sub', 'and_': 'And', 'or_': 'Or', 'xor_': 'Xor'}
+_JUMPS = {'JP_nn_impl(cpu, cpu.readPC16());': 'Operand',
+          'JR_n_impl(cpu, cpu.readPC());': 'Relative',
+          'cpu.reg.setPC(cpu.reg.getHL());': 'HL'}
+
+
+def native_address(s):
+    for address, loc in _ADDRESSES:
+        if s == address:
+            return loc
+    return None
+
+
+def native_source(s):
+    m = re.match(r'^cpu\.reg\.get' + _R8 + r'\(\)$', s)
+    if m:
+        return m.group(1)
+    if s == 'cpu.readPC()':
+        return 'Operand'
+    m = re.match(r'^cpu\.bus\.read\((.*)\)$', s)
+    if m:
+        return native_address(m.group(1))
+    return None
+
+
+def native_parts(impl):
+    if impl == '':
+        return 'Nop', 'None', 'None', 'Always'
+    m = re.match(r'^cpu\.reg\.set' + _R8 + r'\((.*)\);$', impl)
+    if m and native_source(m.group(2)):
+        return 'Load', m.group(1), native_source(m.group(2)), 'Always'
+    m = re.match(r'^cpu\.reg\.set(BC|DE|HL|SP)\(cpu\.readPC16\(\)\);$', impl)
+    if m:
+        return 'Load16', m.group(1), 'Operand', 'Always'
+    m = re.match(r'^cpu\.bus\.write\((.*), (cpu\.reg\.get[A-L]\(\)|cpu\.readPC\(\))\);$', impl)
+    if m and native_address(m.group(1)):
+        return 'Load', native_address(m.group(1)), native_source(m.group(2)), 'Always'
+    m = re.match(r'^alu::(\w+)\(cpu\.reg\.getAMut\(\), (.*), cpu\);$', impl)
+    if m and m.group(1) in _ALU and native_source(m.group(2)):
+        return _ALU[m.group(1)], 'A', native_source(m.group(2)), 'Always'
+    m = re.match(r'^alu::cp\(cpu\.reg\.getA\(\), (.*), cpu\);$', impl)
+    if m and native_source(m.group(1)):
+        return 'Cp', 'A', native_source(m.group(1)), 'Always'
+    m = re.match(r'^alu::(inc|dec)\(cpu\.reg\.get' + _R8 + r'Mut\(\), cpu\);$', impl)
+    if m:
+        return m.group(1).capitalize(), m.group(2), 'None', 'Always'
+    m = re.match(r'^cpu\.reg\.(inc|dec)(BC|DE|HL|SP)\(\);$', impl)
+    if m:
+        return m.group(1).capitalize() + '16', m.group(2), 'None', 'Always'
+    if impl in _JUMPS:
+        return 'Jump', 'None', _JUMPS[impl], 'Always'
+    m = re.match(r'^if \((!?)cpu\.reg\.flags\.get(Z|C)\(\)\) \{ (.*) ticks \+= \d+; \} '
+                 r'else \{ \(void\)cpu\.readPC(16)?\(\); \}$', impl)
+    if m and m.group(3) in _JUMPS:
+        return 'Jump', 'None', _JUMPS[m.group(3)], ('N' if m.group(1) else '') + m.group(2)
+    return 'Call', 'None', 'None', 'Always'
+
+
+def native(op):
+    impl = ' '.join(op.implementation.split())
+    hl_step = 0
+    for suffix, step in ((' cpu.reg.incHL();', 1), (' cpu.reg.decHL();', -1)):
+        if impl.endswith(suffix):
+            impl = impl[:-len(suffix)]
+            hl_step = step
+    kind, dst, src, condition = native_parts(impl)
+    if hl_step != 0 and 'AtHL' not in (dst, src):
+        kind, dst, src, condition, hl_step = 'Call', 'None', 'None', 'Always', 0
+    return ('{{gem::op::Native::Kind::{}, gem::op::Native::Loc::{}, '
+            'gem::op::Native::Loc::{}, gem::op::Native::Condition::{}, {}, {}}}').format(
+        kind, dst, src, condition, hl_step, op.ticks)
+
+
+def make_exec_defs(ops):
+    def make_exec_def(op):
+        return """gem::DeltaTicks exec_{sname}(gem::CPU& cpu, const gem::u16 operand) {{
+    (void)cpu;
+    (void)operand;
+    using namespace gem;
+    DeltaTicks ticks = 0;
+    {impl}
+    ticks += {ticks};
+    return ticks;
+}}""".format(sname=sanitize_name(op.name), ticks=op.ticks, impl=make_exec_impl(op))
+    return '\n'.join(make_exec_def(op) for op in ops)
+
+
+def make_decode_tables(ops, two_byte_prefixes):
+    one_byte_ops, two_byte_ops = partition_two_byte_ops(ops, two_byte_prefixes)
+
+    def make_entry(op):
+        if op is None:
+            return '{nullptr, 0, 0, true, false, gem::op::Reads::Nothing, {}},'
+        return '{{::exec_{}, {}, {}, {}, {}, gem::op::Reads::{}, {}}},'.format(
+            sanitize_name(op.name), operand_bytes(op), max_ticks(op),
+            'true' if ends_block(op) else 'false',
+            'true' if is_pure(op) else 'false', reads(op), native(op))
+
+    def make_table(by_code):
+        return ('\n' + ' '*4).join(make_entry(by_code.get(i)) for i in range(256))
+
+    table = make_table(dict((int(op.val, base=0), op) for op in one_byte_ops))
+    prefix_tables = []
+    for prefix, prefixed_ops in sorted(two_byte_ops.items()):
+        prefix_tables.append("""const std::array<gem::op::DecodeInfo, 256> gem::op::decodeTable_0x{:02X} = {{{{
+    {}
+}}}};""".format(int(prefix, base=0), make_table(dict((int(op.second_byte, base=0), op) for op in prefixed_ops))))
+    return table, '\n'.join(prefix_tables)
+
+
 def partition_two_byte_ops(ops, two_byte_prefixes):
     one_byte_ops = [op for op in ops if op.val not in two_byte_prefixes]
 
@@ -226,21 +516,173 @@ def make_runners(ops, two_byte_prefixes):
     return '{one}\n{ws}{two}'.format(one=one_byte_runners, ws=' '*8, two=two_byte_runners)
 
 
+# how many fused handlers to generate at most
+MAX_FUSIONS = 48
+
+
+def op_code(op):
+    if op.second_byte is not None:
+        return (int(op.val, base=0) << 8) | int(op.second_byte, base=0)
+    return int(op.val, base=0)
+
+
+def code_name(code):
+    return '0x{:02X}'.format(code) if code <= 0xFF else '0x{:04X}'.format(code)
+
+
+# a fusion table has one run of opcodes per line, after the number of times
+# it was seen: `1234 0x05 0x20`. runs can only be fused if no instruction
+# but the last writes memory or changes what the CPU does next (is_pure), and
+# if their operands fit in the 16 bits a block cache micro-op has for them.
+# reads are allowed: fused code only runs on the block cache's fast path,
+# which takes a block only when no device event falls within its budget, so
+# a read like LDH A,(n) sees what it would have one instruction at a time.
+def read_fusions(path, ops):
+    by_code = dict((op_code(op), op) for op in ops)
+    candidates = []
+    with open(path) as f:
+        for line in f:
+            words = line.split()
+            if not words or words[0].startswith('#'):
+                continue
+            count = int(words[0])
+            run = [by_code.get(int(w, base=0)) for w in words[1:]]
+            if len(run) < 2 or None in run:
+                continue
+            if any(ends_block(op) or not is_pure(op) for op in run[:-1]):
+                continue
+            if sum(operand_bytes(op) for op in run) > 2:
+                continue
+            # every fused instruction saves one dispatch
+            candidates.append((count * (len(run) - 1), run))
+    candidates.sort(key=lambda c: -c[0])
+    fusions = []
+    for _, run in candidates:
+        if run not in fusions:
+            fusions.append(run)
+    return fusions[:MAX_FUSIONS]
+
+
+def fused_name(run):
+    return 'exec_fused_{}'.format('_'.join(code_name(op_code(op)) for op in run))
+
+
+def make_fusions(fusions):
+    def make_fused_def(run):
+        calls = []
+        shift = 0
+        for op in run:
+            # the parts' operands are packed low byte first
+            if operand_bytes(op) == 0:
+                operand = '0'
+            elif shift == 0:
+                operand = 'operand'
+            else:
+                operand = 'gem::u16(operand >> {}u)'.format(shift)
+            calls.append('::exec_{}(cpu, {});'.format(sanitize_name(op.name), operand))
+            shift += 8 * operand_bytes(op)
+        body = ('\n' + ' '*4 + 'ticks += ').join(calls)
+        return """gem::DeltaTicks {name}(gem::CPU& cpu, const gem::u16 operand) {{
+    (void)operand;
+    gem::DeltaTicks ticks = {body}
+    return ticks;
+}}""".format(name=fused_name(run), body=body)
+
+    def make_entry(run):
+        parts = ['::exec_{}'.format(sanitize_name(op.name)) for op in run ]
+        parts += ['nullptr'] * (3 - len(run))
+        operands = [str(operand_bytes(op)) for op in run] + ['0'] * (3 - len(run))
+        return '{{{{{{{}}}}}, {{{{{}}}}}, ::{}}},'.format(
+            ', '.join(parts), ', '.join(operands), fused_name(run))
+
+    return ('\n'.join(make_fused_def(run) for run in fusions),
+            ('\n' + ' '*4).join(make_entry(run) for run in fusions))
+
+
+def make_threaded(ops, two_byte_prefixes):
+    one_byte_ops, two_byte_ops = partition_two_byte_ops(ops, two_byte_prefixes)
+
+    def label(val, prefix=None):
+        if prefix is None:
+            return 'op_0x{:02X}'.format(int(val, base=0))
+        return 'op_0x{:02X}_0x{:02X}'.format(int(prefix, base=0), int(val, base=0))
+
+    def prefix_label(prefix):
+        return 'prefix_0x{:02X}'.format(int(prefix, base=0))
+
+    def table_name(prefix):
+        return 'dispatchTable_0x{:02X}'.format(int(prefix, base=0))
+
+    def switch_name(prefix):
+        return 'dispatchSwitch_0x{:02X}'.format(int(prefix, base=0))
+
+    def make_table(labels):
+        entries = ['&&' + labels.get(i, 'unimplemented') for i in range(256)]
+        rows = [', '.join(entries[i:i + 4]) for i in range(0, 256, 4)]
+        return (',\n' + ' '*8).join(rows)
+
+    def make_switch(labels):
+        return ('\n' + ' '*8).join('case 0x{:02X}: goto {};'.format(i, labels[i])
+                                   for i in sorted(labels))
+
+    labels = dict((int(op.val, base=0), label(op.val)) for op in one_byte_ops)
+    for prefix in two_byte_ops:
+        labels[int(prefix, base=0)] = prefix_label(prefix)
+
+    handlers = ['{}: GEM_NEXT(::run_{}(cpu));'.format(label(op.val), sanitize_name(op.name))
+                for op in one_byte_ops]
+    prefix_tables = []
+    prefix_switches = []
+    for prefix, prefixed_ops in sorted(two_byte_ops.items()):
+        prefixed_ops = sorted(prefixed_ops, key=lambda op: int(op.second_byte, base=0))
+        prefixed_labels = dict((int(op.second_byte, base=0), label(op.second_byte, prefix))
+                               for op in prefixed_ops)
+        handlers.append('{}:\n{ws}opcode = cpu.readPC();\n{ws}GEM_DISPATCH({}, {});'.format(
+            prefix_label(prefix), table_name(prefix), switch_name(prefix), ws=' '*4))
+        handlers.extend('{}: GEM_NEXT(::run_{}(cpu));'.format(label(op.second_byte, prefix), sanitize_name(op.name))
+                        for op in prefixed_ops)
+        prefix_tables.append('static void* const {}[256] = {{\n{ws}{}\n    }};'.format(
+            table_name(prefix), make_table(prefixed_labels), ws=' '*8))
+        prefix_switches.append('{}:\n    switch (opcode) {{\n{ws}{}\n    }}\n    goto unimplemented;'.format(
+            switch_name(prefix), make_switch(prefixed_labels), ws=' '*8))
+
+    return _THREADED_SKELETON.format(
+        table=make_table(labels),
+        prefix_tables=('\n' + ' '*4).join(prefix_tables),
+        handlers=('\n' + ' '*4).join(handlers),
+        switch_cases=make_switch(labels),
+        prefix_switches=('\n' + ' '*4).join(prefix_switches))
+
+
 def main():
-    if len(sys.argv) != 3:
-        print 'usage: {} inputfile outputfile'.format(sys.argv[0])
+    args = sys.argv[1:]
+    threaded = '--threaded' in args
+    if threaded:
+        args.remove('--threaded')
+    fusion_table = None
+    if '--fuse' in args:
+        i = args.index('--fuse')
+        fusion_table = args[i + 1]
+        del args[i:i + 2]
+    if len(args) != 2:
+        print 'usage: {} [--threaded] [--fuse table] inputfile outputfile'.format(sys.argv[0])
         exit(1)
 
-    print "generating '{}' from '{}'".format(sys.argv[2], sys.argv[1])
-    ops_module = imp.load_source('opcode', sys.argv[1])
+    print "generating '{}' from '{}'".format(args[1], args[0])
+    ops_module = imp.load_source('opcode', args[0])
     ops = sorted(list(ops_module.opcodes), key=lambda op: int(op.val, base=0))
 
+    decode_table, prefix_decode_tables = make_decode_tables(ops, ops_module.two_byte_prefixes)
+    fused_defs, fusions = make_fusions(read_fusions(fusion_table, ops) if fusion_table else [])
     out = _GEN_SKELETON.format(defs=make_defs(
-        ops), getters=make_getters(ops, ops_module.two_byte_prefixes),
+        ops), exec_defs=make_exec_defs(ops),
+        decode_table=decode_table, prefix_decode_tables=prefix_decode_tables,
+        fused_defs=fused_defs, fusions=fusions, getters=make_getters(ops, ops_module.two_byte_prefixes),
         runners=make_runners(ops, ops_module.two_byte_prefixes),
         helper_functions='\n'.join(ops_module.helper_functions),
-        globals_='\n'.join(ops_module.globals_))
-    with safe_open_w(sys.argv[2]) as f:
+        globals_='\n'.join(ops_module.globals_),
+        threaded=make_threaded(ops, ops_module.two_byte_prefixes) if threaded else '')
+    with safe_open_w(args[1]) as f:
         f.write(out)
     print "done"
 